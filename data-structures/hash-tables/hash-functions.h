@@ -0,0 +1,123 @@
+#ifndef HASH_FUNCTIONS_H
+#define HASH_FUNCTIONS_H
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+// Hash functions shared by the hash tables in this directory.
+//
+// The textbook "value = value * 37 + key[i]" hashes one byte per step, needs a separate
+// strlen(), and is easy to attack: similar keys collide ("azin" and "aZMZ" landed in the
+// same slot), and anyone who knows the function can choose keys that all collide.
+// hashString() is wyhash (final version 4): it reads the key 8 or 16 bytes at a time and
+// mixes with 64x64->128 bit multiplications, and it takes a seed. Every table picks its own
+// random seed with hashSeed(), so colliding keys cannot be precomputed (this is not
+// cryptographic protection, just the usual defense against hash flooding).
+// For integer keys hashInt() is the murmur3 64-bit finalizer (a bijection, so distinct keys never
+// collide before reduction), and multiplyShift() is the multiplication method from CLRS:
+// the top "bits" bits of a * k for a random odd a.
+//
+// Reads are done with memcpy() (unaligned-safe) and assume a little-endian machine.
+
+static inline void wyMum(uint64_t* a, uint64_t* b){
+    __uint128_t r = (__uint128_t)*a * *b;
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+}
+
+static inline uint64_t wyMix(uint64_t a, uint64_t b){
+    wyMum(&a, &b);
+    return a ^ b;
+}
+
+static inline uint64_t wyRead8(const uint8_t* p){
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static inline uint64_t wyRead4(const uint8_t* p){
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline uint64_t wyRead3(const uint8_t* p, size_t k){
+    return ((uint64_t)p[0] << 16) | ((uint64_t)p[k >> 1] << 8) | p[k - 1];
+}
+
+static const uint64_t wySecret[4] = {0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL,
+                                     0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL};
+
+static inline uint64_t hashString(const void* key, size_t len, uint64_t seed){
+    const uint8_t* p = key;
+    uint64_t a, b;
+    seed ^= wyMix(seed ^ wySecret[0], wySecret[1]);
+    if(len <= 16){
+        if(len >= 4){
+            a = (wyRead4(p) << 32) | wyRead4(p + ((len >> 3) << 2));
+            b = (wyRead4(p + len - 4) << 32) | wyRead4(p + len - 4 - ((len >> 3) << 2));
+        }
+        else if(len > 0){
+            a = wyRead3(p, len);
+            b = 0;
+        }
+        else{
+            a = b = 0;
+        }
+    }
+    else{
+        size_t i = len;
+        if(i > 48){
+            uint64_t see1 = seed, see2 = seed;
+            do{
+                seed = wyMix(wyRead8(p) ^ wySecret[1], wyRead8(p + 8) ^ seed);
+                see1 = wyMix(wyRead8(p + 16) ^ wySecret[2], wyRead8(p + 24) ^ see1);
+                see2 = wyMix(wyRead8(p + 32) ^ wySecret[3], wyRead8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            }while(i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while(i > 16){
+            seed = wyMix(wyRead8(p) ^ wySecret[1], wyRead8(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = wyRead8(p + i - 16);
+        b = wyRead8(p + i - 8);
+    }
+    a ^= wySecret[1];
+    b ^= seed;
+    wyMum(&a, &b);
+    return wyMix(a ^ wySecret[0] ^ len, b ^ wySecret[1]);
+}
+
+static inline uint64_t fmix64(uint64_t k){
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+static inline uint64_t hashInt(uint64_t key, uint64_t seed){
+    return fmix64(key ^ seed);
+}
+
+// 1 <= bits <= 64, a must be odd (e.g. hashSeed() | 1)
+static inline uint64_t multiplyShift(uint64_t key, uint64_t a, unsigned int bits){
+    return (a * key) >> (64 - bits);
+}
+
+// A fresh seed per call: time, clock, a stack address (randomized by ASLR) and a counter
+static inline uint64_t hashSeed(void){
+    static uint64_t counter = 0;
+    uint64_t local = (uint64_t)time(NULL) ^ ((uint64_t)clock() << 32);
+    local ^= (uint64_t)(uintptr_t)&local;
+    return fmix64(local + 0x9e3779b97f4a7c15ULL * ++counter);
+}
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef HASH_TABLE_STATS_H
+#define HASH_TABLE_STATS_H
+
+#include <stdio.h>
+#include <string.h>
+
+// Statistics of the hash tables in this directory, for finding out why lookups are slow.
+// Compile with -DHASH_TABLE_STATS to get them; otherwise every macro below expands to nothing,
+// the tables have no counters at all and the report functions do not exist.
+//
+// Two kinds of numbers are collected:
+//  counters (hashTableStats) updated by the operations themselves: how many slots or nodes every
+//  insert/delete/lookup examined, as a histogram, and how many times the table was resized.
+//  One increment per operation, so they are cheap enough to leave on;
+//  a report (hashTableReport) made on request by scanning the table: count, load factor, tombstones,
+//  the histogram of chain lengths (for chaining) and an estimate of the memory per entry.
+// statsPrintJson() writes a report as one line of JSON, for scripts and dashboards.
+//
+// Histograms have STATS_BUCKETS buckets, histogram[i] counts the lengths equal to i, and the last
+// bucket also counts all longer ones.
+
+#define STATS_BUCKETS 32
+#define STATS_MALLOC_OVERHEAD 16   // usual bookkeeping bytes of one malloc()'ed block
+
+#ifdef HASH_TABLE_STATS
+
+typedef struct HashTableStats{
+    unsigned long operations;
+    unsigned long probeLengths[STATS_BUCKETS];   // operations by the number of slots or nodes examined
+    unsigned long resizes;
+} hashTableStats;
+
+typedef struct HashTableReport{
+    hashTableStats counters;
+    size_t capacity;                             // slots or buckets
+    size_t count;
+    size_t tombstones;
+    double loadFactor;
+    double bytesPerEntry;                        // all memory of the table / count
+    int hasChains;
+    unsigned long chainLengths[STATS_BUCKETS];   // buckets by the number of nodes in them
+} hashTableReport;
+
+static inline void statsRecord(unsigned long* histogram, size_t length){
+    ++histogram[length < STATS_BUCKETS ? length : STATS_BUCKETS - 1];
+}
+
+static inline void statsRecordProbe(hashTableStats* stats, size_t probes){
+    ++(stats->operations);
+    statsRecord(stats->probeLengths, probes);
+}
+
+static inline void statsPrintHistogram(FILE* out, const char* name, const unsigned long* histogram){
+    int last = STATS_BUCKETS - 1;
+    while(last > 0 && histogram[last] == 0){
+        --last;
+    }
+    fprintf(out, ",\"%s\":[", name);
+    for(int i = 0; i <= last; i++){
+        fprintf(out, i ? ",%lu" : "%lu", histogram[i]);
+    }
+    fprintf(out, "]");
+}
+
+static inline void statsPrintJson(FILE* out, const hashTableReport* report){
+    fprintf(out, "{\"capacity\":%zu,\"count\":%zu,\"loadFactor\":%.4f,\"tombstones\":%zu,"
+                 "\"resizes\":%lu,\"bytesPerEntry\":%.1f,\"operations\":%lu",
+            report->capacity, report->count, report->loadFactor, report->tombstones,
+            report->counters.resizes, report->bytesPerEntry, report->counters.operations);
+    statsPrintHistogram(out, "probeLengths", report->counters.probeLengths);
+    if(report->hasChains){
+        statsPrintHistogram(out, "chainLengths", report->chainLengths);
+    }
+    fprintf(out, "}\n");
+}
+
+#define STATS_FIELD hashTableStats stats;
+#define STATS_INIT(table) memset(&(table)->stats, 0, sizeof(hashTableStats))
+#define STATS_PROBE(table, probes) statsRecordProbe(&(table)->stats, (probes))
+#define STATS_RESIZE(table) (++(table)->stats.resizes)
+
+#else
+
+#define STATS_FIELD
+#define STATS_INIT(table) ((void)0)
+#define STATS_PROBE(table, probes) ((void)0)
+#define STATS_RESIZE(table) ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,383 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hash-functions.h"
+#include "key-store.h"
+
+// Hash table with chaining, tuned for many keys.
+// Differences from hash-table_with_chaining.c:
+//  New nodes are inserted at the head of the chain in O(1): the order inside a chain does not matter,
+//  and insert() has to search the chain for the key anyway, so walking it again to the end is wasted.
+//  Every node caches the full 64-bit hash of its key. Two different keys in the same chain almost
+//  never have equal hashes, so the key bytes are compared only for the node we are looking for.
+//  Nodes and keys are not malloc()'ed one by one. Nodes are cut from slabs of NODES_PER_SLAB nodes
+//  (deleted nodes go to a free list and are reused), and keys are kept in keyRefs: short keys inside
+//  the node, long ones appended to the table's keyStore (see key-store.h).
+//  This removes the per-allocation overhead (usually 16 bytes per malloc) and keeps nodes close in memory.
+//  The bytes of deleted long keys are given back by deleteKey(), which compacts the store once they
+//  fill half of it, so a delete/insert workload does not grow the table's memory.
+//  The number of buckets doubles when the load factor reaches 1. To avoid a long pause,
+//  the resize is incremental, like in Redis: both the old and the new bucket array are kept,
+//  and every insert, search and delete moves REHASH_STEP buckets from the old array to the new one.
+//  While the move is in progress, new keys go to the new array and searches look in both.
+//  The cached hashes mean that moving a node never rehashes its key.
+//  lookupBatch() and insertBatch() take groups of BATCH_GROUP keys through the table in stages,
+//  so that the cache misses of a whole group overlap: first all keys are hashed and their buckets
+//  are prefetched, then the head node of every bucket is prefetched, and only then the chains are
+//  walked. One lookup in a big table costs two dependent misses (bucket, then node); with the stages
+//  a group pays them roughly twice in total instead of twice per key.
+
+#define INITIAL_BUCKETS 16       // must be a power of two
+#define REHASH_STEP 1            // buckets moved per operation
+#define NODES_PER_SLAB 1024
+#define BATCH_GROUP 16           // keys whose buckets are prefetched together
+
+typedef struct Node{
+    struct Node *next;
+    uint64_t hash;
+    keyRef key;
+    int data;
+} node;
+
+typedef struct Buckets{
+    node** heads;
+    size_t size;      // power of two
+    size_t count;
+} buckets;
+
+typedef struct Slab{
+    struct Slab *next;
+    node nodes[NODES_PER_SLAB];
+} slab;
+
+typedef struct HashTable{
+    buckets ht[2];      // ht[1] is used only while rehashing
+    long rehashIdx;     // next bucket of ht[0] to move, -1 if not rehashing
+    uint64_t seed;
+
+    slab* slabs;
+    size_t slabUsed;    // nodes handed out from the newest slab
+    node* freeNodes;
+    keyStore keys;
+} hashTable;
+
+
+void initBuckets(buckets* b, size_t size){
+    b->heads = calloc(size, sizeof(node*));
+    b->size = size;
+    b->count = 0;
+}
+
+hashTable* newHashTable(){
+    hashTable* table = malloc(sizeof(hashTable));
+    initBuckets(&table->ht[0], INITIAL_BUCKETS);
+    table->ht[1].heads = NULL;
+    table->ht[1].size = table->ht[1].count = 0;
+    table->rehashIdx = -1;
+    table->seed = hashSeed();
+    table->slabs = NULL;
+    table->slabUsed = NODES_PER_SLAB;
+    table->freeNodes = NULL;
+    keyStoreInit(&table->keys);
+
+    return table;
+}
+
+node* allocNode(hashTable* table){
+    if(table->freeNodes != NULL){
+        node* n = table->freeNodes;
+        table->freeNodes = n->next;
+        return n;
+    }
+    if(table->slabUsed == NODES_PER_SLAB){
+        slab* s = malloc(sizeof(slab));
+        s->next = table->slabs;
+        table->slabs = s;
+        table->slabUsed = 0;
+    }
+    return &table->slabs->nodes[table->slabUsed++];
+}
+
+void freeNode(hashTable* table, node* n){
+    n->next = table->freeNodes;
+    table->freeNodes = n;
+}
+
+// Copies the keys of all nodes in both bucket arrays to a fresh store, leaving out the deleted ones
+void compactKeys(hashTable* table){
+    keyStore fresh;
+    keyStoreInit(&fresh);
+    for(int t = 0; t <= (table->rehashIdx >= 0); t++){
+        buckets* b = &table->ht[t];
+        for(size_t i = 0; i < b->size; ++i){
+            for(node* entry = b->heads[i]; entry != NULL; entry = entry->next){
+                keyStoreRelocate(&fresh, &table->keys, &entry->key);
+            }
+        }
+    }
+    keyStoreReplace(&table->keys, &fresh);
+}
+
+// Moves up to n buckets of ht[0] into ht[1]; finishes the rehash when ht[0] is empty.
+// At most 10*n empty buckets are visited, so one step is bounded even in a sparse table.
+void rehashStep(hashTable* table, int n){
+    if(table->rehashIdx < 0){
+        return;
+    }
+    buckets* from = &table->ht[0];
+    buckets* to = &table->ht[1];
+    int emptyVisits = n * 10;
+    while(n-- > 0 && from->count != 0){
+        while(from->heads[table->rehashIdx] == NULL){
+            ++(table->rehashIdx);
+            if(--emptyVisits == 0){
+                return;
+            }
+        }
+        node* entry = from->heads[table->rehashIdx];
+        while(entry != NULL){
+            node* next = entry->next;
+            size_t b = entry->hash & (to->size - 1);
+            entry->next = to->heads[b];
+            to->heads[b] = entry;
+            --(from->count);
+            ++(to->count);
+            entry = next;
+        }
+        from->heads[table->rehashIdx] = NULL;
+        ++(table->rehashIdx);
+    }
+    if(from->count == 0){
+        free(from->heads);
+        table->ht[0] = table->ht[1];
+        table->ht[1].heads = NULL;
+        table->ht[1].size = table->ht[1].count = 0;
+        table->rehashIdx = -1;
+    }
+}
+
+node* searchBuckets(hashTable* table, buckets* b, const char* key, size_t keyLen, uint64_t h){
+    for(node* entry = b->heads[h & (b->size - 1)]; entry != NULL; entry = entry->next){
+        if(entry->hash == h && keyRefEquals(&table->keys, &entry->key, key, keyLen)){
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+node* search(hashTable* table, const char* key, size_t keyLen, uint64_t h){
+    node* entry = searchBuckets(table, &table->ht[0], key, keyLen, h);
+    if(entry == NULL && table->rehashIdx >= 0){
+        entry = searchBuckets(table, &table->ht[1], key, keyLen, h);
+    }
+    return entry;
+}
+
+// insert() without the rehash step, for a key whose length and hash are known
+void insertHashed(hashTable* table, const char* key, size_t keyLen, uint64_t h, int value){
+    node* entry = search(table, key, keyLen, h);
+    if(entry != NULL){
+        entry->data = value;
+        return;
+    }
+
+    if(table->rehashIdx < 0 && table->ht[0].count >= table->ht[0].size){
+        initBuckets(&table->ht[1], table->ht[0].size * 2);
+        table->rehashIdx = 0;
+    }
+    buckets* b = table->rehashIdx >= 0 ? &table->ht[1] : &table->ht[0];
+    size_t slot = h & (b->size - 1);
+    entry = allocNode(table);
+    entry->hash = h;
+    entry->key = keyStoreAdd(&table->keys, key, keyLen);
+    entry->data = value;
+    entry->next = b->heads[slot];
+    b->heads[slot] = entry;
+    ++(b->count);
+}
+
+void insert(hashTable* table, const char* key, int value){
+    rehashStep(table, REHASH_STEP);
+    size_t keyLen = strlen(key);
+    insertHashed(table, key, keyLen, hashString(key, keyLen, table->seed), value);
+}
+
+int popKey(hashTable* table, const char* key){
+    rehashStep(table, REHASH_STEP);
+    size_t keyLen = strlen(key);
+    node* entry = search(table, key, keyLen, hashString(key, keyLen, table->seed));
+    if(entry == NULL){
+        return 0;
+    }
+    else{
+        return entry->data;
+    }
+}
+
+// Hashes keys[0..m-1] and prefetches their buckets in every bucket array in use
+void prefetchBuckets(hashTable* table, const char* keys[], size_t m, size_t lens[], uint64_t hashes[]){
+    for(size_t i = 0; i < m; ++i){
+        lens[i] = strlen(keys[i]);
+        hashes[i] = hashString(keys[i], lens[i], table->seed);
+        for(int t = 0; t <= (table->rehashIdx >= 0); t++){
+            __builtin_prefetch(&table->ht[t].heads[hashes[i] & (table->ht[t].size - 1)]);
+        }
+    }
+}
+
+// Second stage: the buckets are in the cache now, prefetch the first node of every chain
+void prefetchHeads(hashTable* table, size_t m, const uint64_t hashes[]){
+    for(size_t i = 0; i < m; ++i){
+        for(int t = 0; t <= (table->rehashIdx >= 0); t++){
+            node* head = table->ht[t].heads[hashes[i] & (table->ht[t].size - 1)];
+            if(head != NULL){
+                __builtin_prefetch(head);
+            }
+        }
+    }
+}
+
+// Looks up keys[0..n-1]: out[i] gets the value of keys[i], found[i] (if found != NULL)
+// tells whether keys[i] is in the table. Returns the number of keys found
+size_t lookupBatch(hashTable* table, const char* keys[], size_t n, int out[], char found[]){
+    size_t lens[BATCH_GROUP];
+    uint64_t hashes[BATCH_GROUP];
+    size_t hits = 0;
+    for(size_t first = 0; first < n; first += BATCH_GROUP){
+        size_t m = n - first < BATCH_GROUP ? n - first : BATCH_GROUP;
+        rehashStep(table, REHASH_STEP);
+        prefetchBuckets(table, keys + first, m, lens, hashes);
+        prefetchHeads(table, m, hashes);
+        for(size_t i = 0; i < m; ++i){
+            node* entry = search(table, keys[first + i], lens[i], hashes[i]);
+            if(entry != NULL){
+                out[first + i] = entry->data;
+                ++hits;
+            }
+            if(found != NULL){
+                found[first + i] = entry != NULL;
+            }
+        }
+    }
+    return hits;
+}
+
+// Inserts keys[i] with values[i] for i = 0..n-1, in this order
+void insertBatch(hashTable* table, const char* keys[], const int values[], size_t n){
+    size_t lens[BATCH_GROUP];
+    uint64_t hashes[BATCH_GROUP];
+    for(size_t first = 0; first < n; first += BATCH_GROUP){
+        size_t m = n - first < BATCH_GROUP ? n - first : BATCH_GROUP;
+        rehashStep(table, REHASH_STEP * m);
+        prefetchBuckets(table, keys + first, m, lens, hashes);
+        prefetchHeads(table, m, hashes);
+        // a rehash started in the middle of the group only makes some prefetches useless
+        for(size_t i = 0; i < m; ++i){
+            insertHashed(table, keys[first + i], lens[i], hashes[i], values[first + i]);
+        }
+    }
+}
+
+void deleteKey(hashTable* table, const char* key){
+    rehashStep(table, REHASH_STEP);
+    size_t keyLen = strlen(key);
+    uint64_t h = hashString(key, keyLen, table->seed);
+    for(int t = 0; t <= (table->rehashIdx >= 0); t++){
+        buckets* b = &table->ht[t];
+        for(node** link = &b->heads[h & (b->size - 1)]; *link != NULL; link = &(*link)->next){
+            node* entry = *link;
+            if(entry->hash == h && keyRefEquals(&table->keys, &entry->key, key, keyLen)){
+                *link = entry->next;
+                --(b->count);
+                keyStoreRelease(&table->keys, &entry->key);
+                freeNode(table, entry);
+                if(keyStoreNeedsCompaction(&table->keys)){
+                    compactKeys(table);
+                }
+                return;
+            }
+        }
+    }
+}
+
+void dumpHashTable(hashTable* table){
+    for(int t = 0; t <= (table->rehashIdx >= 0); t++){
+        buckets* b = &table->ht[t];
+        printf("ht[%d] (%zu buckets, %zu keys):\n", t, b->size, b->count);
+        for(size_t i = 0; i < b->size; ++i){
+            node* entry = b->heads[i];
+            if(entry == NULL){
+                continue;
+            }
+            printf("slot[%4zu]: ", i);
+            for(; entry != NULL; entry = entry->next){
+                printf("%.*s = %d ", (int)keyRefLen(&entry->key), keyRefBytes(&table->keys, &entry->key), entry->data);
+            }
+            printf("\n");
+        }
+    }
+}
+
+void freeHashTable(hashTable* table){
+    free(table->ht[0].heads);
+    free(table->ht[1].heads);
+    while(table->slabs != NULL){
+        slab* next = table->slabs->next;
+        free(table->slabs);
+        table->slabs = next;
+    }
+    keyStoreFree(&table->keys);
+    free(table);
+}
+
+
+int main(int argc, char* argv[]){
+    hashTable* myTable = newHashTable();
+
+    insert(myTable, "name1", 1);
+    insert(myTable, "name2", 2);
+    insert(myTable, "name3", 3);
+    insert(myTable, "name4", 4);
+    insert(myTable, "name5", 5);
+    insert(myTable, "name6", 6);
+    insert(myTable, "name7", 7);
+
+    dumpHashTable(myTable);
+    printf("\n");
+
+    insert(myTable, "name1", 8);
+
+    deleteKey(myTable, "name1");
+    dumpHashTable(myTable);
+    printf("\n");
+
+    insert(myTable, "name1", 1);
+    printf("%d\n\n", popKey(myTable, "name1"));
+
+    // 17th key starts an incremental rehash, so both arrays are in use for a while
+    char key[16];
+    for(int i = 8; i <= 17; i++){
+        sprintf(key, "name%d", i);
+        insert(myTable, key, i);
+    }
+    dumpHashTable(myTable);
+    printf("\n");
+
+    // batches: keys name0..name999 are inserted, then name500..name1499 are looked up
+    enum { BATCH = 1000 };
+    static char names[2 * BATCH][16];
+    const char* batchKeys[2 * BATCH];
+    int values[BATCH], results[BATCH];
+    for(int i = 0; i < 2 * BATCH; i++){
+        sprintf(names[i], "name%d", i);
+        batchKeys[i] = names[i];
+    }
+    for(int i = 0; i < BATCH; i++){
+        values[i] = i;
+    }
+    insertBatch(myTable, batchKeys, values, BATCH);
+    size_t hits = lookupBatch(myTable, batchKeys + BATCH / 2, BATCH, results, NULL);
+    printf("found %zu of %d, name600 -> %d\n", hits, BATCH, results[100]);
+
+    freeHashTable(myTable);
+}
@@ -0,0 +1,451 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "hash-functions.h"
+
+// Concurrent open-addressing hash table: striped seqlocks for writers, optimistic
+// lock-free reads, and a resize that every writer helps to finish.
+//
+// Layout. Slots live in one flat array of capacity m (a power of two). A key may be stored in any
+// of the NEIGHBORHOOD slots after its home slot h & (m - 1) (like in hopscotch hashing, but without moving
+// entries around: if the neighborhood is full, the table grows). Searching always scans the whole
+// neighborhood, so a deleted slot can simply become empty again - no tombstones.
+// The array is cut into stripes of STRIPE_SIZE >= NEIGHBORHOOD slots, so a neighborhood touches one or
+// two stripes. Each stripe has a sequence counter (a seqlock):
+//  a writer locks a stripe by moving its counter from even to odd (CAS), and unlocks by making it even again;
+//  two stripes are always locked in increasing index order, so writers cannot deadlock.
+//  a reader never writes shared memory: it reads the counters (they must be even), scans the slots,
+//  and reads the counters again; if they changed, a writer was there and the read is retried.
+// So read-mostly workloads scale with the number of cores: readers do not bounce a lock's cache line.
+// Keys are stored inline in the slot (at most KEY_SIZE - 1 bytes). A reader may look at a slot while it
+// is being rewritten; with inline keys it only ever reads memory of the table, and a torn key is
+// thrown away by the seqlock validation (there is no pointer that a writer could free under it).
+//
+// Resize. When a neighborhood is full or the load exceeds 3/4, the array gets a successor of twice
+// the size (array->next). From then on:
+//  every writer first helps: it claims HELP_STRIPES not yet migrated stripes and copies them into the
+//  new array, and it makes sure the stripes of its own key are migrated; then it works on the new array;
+//  migrating a stripe happens under the stripe's lock and ends by marking the stripe "moved";
+//  a reader scans the stripes of the key that are not moved (their contents are still current), and
+//  follows next only if the key was not found there and one of the stripes is moved.
+// The thread that migrates the last stripe makes the new array the current one. Old arrays are
+// kept on a list until the table is freed, since a slow reader may still be scanning them.
+// Locks are taken from older arrays to newer ones only, so migration cannot deadlock either.
+
+#define INITIAL_CAPACITY 256   // power of two, >= STRIPE_SIZE
+#define STRIPE_SIZE 64         // power of two, >= NEIGHBORHOOD
+#define NEIGHBORHOOD 32
+#define HELP_STRIPES 2
+#define KEY_SIZE 32
+
+typedef struct Slot{
+    _Atomic uint64_t hash;   // 0 means that the slot is empty
+    _Atomic int data;
+    _Atomic unsigned int keyLen;
+    char key[KEY_SIZE];
+} slot;
+
+typedef struct SlotArray{
+    slot* slots;
+    size_t capacity;
+    size_t stripeCount;
+    _Atomic unsigned int* seq;       // one seqlock per stripe
+    _Atomic unsigned char* moved;    // one flag per stripe, set when the stripe has been migrated
+    _Atomic(struct SlotArray*) next;
+    _Atomic size_t migrateNext;      // next stripe to be claimed by a helper
+    _Atomic size_t migrated;         // stripes migrated so far
+    struct SlotArray* retiredNext;
+} slotArray;
+
+typedef struct HashTable{
+    _Atomic(slotArray*) current;
+    _Atomic long count;
+    uint64_t seed;
+    pthread_mutex_t resizeLock;
+    slotArray* retired;
+} hashTable;
+
+
+slotArray* newSlotArray(size_t capacity){
+    slotArray* a = malloc(sizeof(slotArray));
+    a->slots = calloc(capacity, sizeof(slot));
+    a->capacity = capacity;
+    a->stripeCount = capacity / STRIPE_SIZE;
+    a->seq = calloc(a->stripeCount, sizeof(*a->seq));
+    a->moved = calloc(a->stripeCount, sizeof(*a->moved));
+    atomic_init(&a->next, NULL);
+    atomic_init(&a->migrateNext, 0);
+    atomic_init(&a->migrated, 0);
+    a->retiredNext = NULL;
+    return a;
+}
+
+void freeSlotArray(slotArray* a){
+    free(a->slots);
+    free((void*)a->seq);
+    free((void*)a->moved);
+    free(a);
+}
+
+hashTable* newHashTable(){
+    hashTable* table = malloc(sizeof(hashTable));
+    atomic_init(&table->current, newSlotArray(INITIAL_CAPACITY));
+    atomic_init(&table->count, 0);
+    table->seed = hashSeed();
+    pthread_mutex_init(&table->resizeLock, NULL);
+    table->retired = NULL;
+    return table;
+}
+
+uint64_t hash(hashTable* table, const char* key, size_t keyLen){
+    uint64_t h = hashString(key, keyLen, table->seed);
+    return h != 0 ? h : 1;
+}
+
+
+void lockStripe(slotArray* a, size_t s){
+    for(;;){
+        unsigned int v = atomic_load_explicit(&a->seq[s], memory_order_relaxed);
+        if((v & 1) == 0 && atomic_compare_exchange_weak_explicit(&a->seq[s], &v, v + 1,
+                                                                 memory_order_acquire, memory_order_relaxed)){
+            break;
+        }
+    }
+    // slot stores must not become visible before the counter is odd
+    atomic_thread_fence(memory_order_release);
+}
+
+void unlockStripe(slotArray* a, size_t s){
+    atomic_fetch_add_explicit(&a->seq[s], 1, memory_order_release);
+}
+
+// Stripes covering the neighborhood of h, *first <= *second (they are equal for a single stripe)
+void neighborhoodStripes(slotArray* a, uint64_t h, size_t* home, size_t* first, size_t* second){
+    *home = h & (a->capacity - 1);
+    size_t s1 = *home / STRIPE_SIZE;
+    size_t s2 = ((*home + NEIGHBORHOOD - 1) & (a->capacity - 1)) / STRIPE_SIZE;
+    *first = s1 < s2 ? s1 : s2;
+    *second = s1 < s2 ? s2 : s1;
+}
+
+void lockPair(slotArray* a, size_t first, size_t second){
+    lockStripe(a, first);
+    if(second != first){
+        lockStripe(a, second);
+    }
+}
+
+void unlockPair(slotArray* a, size_t first, size_t second){
+    if(second != first){
+        unlockStripe(a, second);
+    }
+    unlockStripe(a, first);
+}
+
+int isMoved(slotArray* a, size_t s){
+    return atomic_load_explicit(&a->moved[s], memory_order_relaxed);
+}
+
+int slotMatches(slot* sl, uint64_t h, const char* key, size_t keyLen){
+    return atomic_load_explicit(&sl->hash, memory_order_relaxed) == h &&
+           atomic_load_explicit(&sl->keyLen, memory_order_relaxed) == keyLen && memcmp(sl->key, key, keyLen) == 0;
+}
+
+void startResize(hashTable* table, slotArray* a){
+    pthread_mutex_lock(&table->resizeLock);
+    if(atomic_load_explicit(&a->next, memory_order_relaxed) == NULL){
+        atomic_store_explicit(&a->next, newSlotArray(a->capacity * 2), memory_order_release);
+    }
+    pthread_mutex_unlock(&table->resizeLock);
+}
+
+// Makes the first array that is still being migrated the current one
+void advanceCurrent(hashTable* table){
+    for(;;){
+        slotArray* cur = atomic_load_explicit(&table->current, memory_order_acquire);
+        slotArray* next = atomic_load_explicit(&cur->next, memory_order_acquire);
+        if(next == NULL || atomic_load_explicit(&cur->migrated, memory_order_acquire) != cur->stripeCount){
+            return;
+        }
+        if(atomic_compare_exchange_strong(&table->current, &cur, next)){
+            pthread_mutex_lock(&table->resizeLock);
+            cur->retiredNext = table->retired;
+            table->retired = cur;
+            pthread_mutex_unlock(&table->resizeLock);
+        }
+    }
+}
+
+int putEntry(hashTable* table, slotArray* a, uint64_t h, const char* key, size_t keyLen, int value, int isNew);
+
+void migrateStripe(hashTable* table, slotArray* a, size_t s){
+    if(atomic_load_explicit(&a->moved[s], memory_order_acquire)){
+        return;
+    }
+    lockStripe(a, s);
+    int done = 0;
+    if(!isMoved(a, s)){
+        slotArray* next = atomic_load_explicit(&a->next, memory_order_acquire);
+        for(size_t i = s * STRIPE_SIZE; i < (s + 1) * STRIPE_SIZE; i++){
+            slot* sl = &a->slots[i];
+            uint64_t h = atomic_load_explicit(&sl->hash, memory_order_relaxed);
+            if(h != 0){
+                putEntry(table, next, h, sl->key, atomic_load_explicit(&sl->keyLen, memory_order_relaxed),
+                         atomic_load_explicit(&sl->data, memory_order_relaxed), 0);
+            }
+        }
+        atomic_store_explicit(&a->moved[s], 1, memory_order_release);
+        done = atomic_fetch_add(&a->migrated, 1) + 1 == a->stripeCount;
+    }
+    unlockStripe(a, s);
+    if(done){
+        advanceCurrent(table);
+    }
+}
+
+// Called by writers that found a->next set: migrate some stripes, including the ones they need
+slotArray* helpMigrate(hashTable* table, slotArray* a, size_t first, size_t second){
+    for(int k = 0; k < HELP_STRIPES; k++){
+        size_t s = atomic_fetch_add(&a->migrateNext, 1);
+        if(s >= a->stripeCount){
+            break;
+        }
+        migrateStripe(table, a, s);
+    }
+    migrateStripe(table, a, first);
+    migrateStripe(table, a, second);
+    return atomic_load_explicit(&a->next, memory_order_acquire);
+}
+
+// Inserts or updates key in a (or in its successors). isNew is 0 for entries being migrated.
+// Returns 1 if a new key was added.
+int putEntry(hashTable* table, slotArray* a, uint64_t h, const char* key, size_t keyLen, int value, int isNew){
+    for(;;){
+        size_t home, first, second;
+        neighborhoodStripes(a, h, &home, &first, &second);
+        if(atomic_load_explicit(&a->next, memory_order_acquire) != NULL){
+            a = helpMigrate(table, a, first, second);
+            continue;
+        }
+
+        lockPair(a, first, second);
+        if(isMoved(a, first) || isMoved(a, second)){   // a resize started after we looked at a->next
+            unlockPair(a, first, second);
+            continue;
+        }
+        slot* freeSlot = NULL;
+        for(size_t i = 0; i < NEIGHBORHOOD; i++){
+            slot* sl = &a->slots[(home + i) & (a->capacity - 1)];
+            if(atomic_load_explicit(&sl->hash, memory_order_relaxed) == 0){
+                if(freeSlot == NULL){
+                    freeSlot = sl;
+                }
+            }
+            else if(slotMatches(sl, h, key, keyLen)){
+                atomic_store_explicit(&sl->data, value, memory_order_relaxed);
+                unlockPair(a, first, second);
+                return 0;
+            }
+        }
+        if(freeSlot != NULL){
+            atomic_store_explicit(&freeSlot->keyLen, keyLen, memory_order_relaxed);
+            memcpy(freeSlot->key, key, keyLen);
+            atomic_store_explicit(&freeSlot->data, value, memory_order_relaxed);
+            atomic_store_explicit(&freeSlot->hash, h, memory_order_relaxed);
+            unlockPair(a, first, second);
+            if(isNew && (size_t)atomic_fetch_add(&table->count, 1) * 4 > a->capacity * 3){
+                startResize(table, a);
+            }
+            return 1;
+        }
+        unlockPair(a, first, second);
+        startResize(table, a);
+    }
+}
+
+// Returns 0 if the key is too long to be stored
+int insert(hashTable* table, const char* key, int value){
+    size_t keyLen = strlen(key);
+    if(keyLen >= KEY_SIZE){
+        return 0;
+    }
+    putEntry(table, atomic_load_explicit(&table->current, memory_order_acquire),
+             hash(table, key, keyLen), key, keyLen, value, 1);
+    return 1;
+}
+
+// Lock-free: returns 1 and stores the value in *value if the key is present
+int pop(hashTable* table, const char* key, int* value){
+    size_t keyLen = strlen(key);
+    if(keyLen >= KEY_SIZE){
+        return 0;
+    }
+    uint64_t h = hash(table, key, keyLen);
+    slotArray* a = atomic_load_explicit(&table->current, memory_order_acquire);
+    for(;;){
+        size_t home, first, second;
+        neighborhoodStripes(a, h, &home, &first, &second);
+        unsigned int v1 = atomic_load_explicit(&a->seq[first], memory_order_acquire);
+        unsigned int v2 = atomic_load_explicit(&a->seq[second], memory_order_acquire);
+        if((v1 | v2) & 1){
+            continue;   // a writer holds the stripe
+        }
+        int movedFirst = isMoved(a, first), movedSecond = isMoved(a, second);
+        int found = 0, data = 0;
+        for(size_t i = 0; i < NEIGHBORHOOD && !found; i++){
+            size_t idx = (home + i) & (a->capacity - 1);
+            size_t s = idx / STRIPE_SIZE;
+            if((s == first && movedFirst) || (s == second && movedSecond)){
+                continue;
+            }
+            slot* sl = &a->slots[idx];
+            if(slotMatches(sl, h, key, keyLen)){
+                data = atomic_load_explicit(&sl->data, memory_order_relaxed);
+                found = 1;
+            }
+        }
+        atomic_thread_fence(memory_order_acquire);
+        if(atomic_load_explicit(&a->seq[first], memory_order_relaxed) != v1 ||
+           atomic_load_explicit(&a->seq[second], memory_order_relaxed) != v2){
+            continue;   // something changed while we were reading, retry
+        }
+        if(found){
+            *value = data;
+            return 1;
+        }
+        if(!movedFirst && !movedSecond){
+            return 0;
+        }
+        a = atomic_load_explicit(&a->next, memory_order_acquire);
+    }
+}
+
+void delete(hashTable* table, const char* key){
+    size_t keyLen = strlen(key);
+    if(keyLen >= KEY_SIZE){
+        return;
+    }
+    uint64_t h = hash(table, key, keyLen);
+    slotArray* a = atomic_load_explicit(&table->current, memory_order_acquire);
+    for(;;){
+        size_t home, first, second;
+        neighborhoodStripes(a, h, &home, &first, &second);
+        if(atomic_load_explicit(&a->next, memory_order_acquire) != NULL){
+            a = helpMigrate(table, a, first, second);
+            continue;
+        }
+        lockPair(a, first, second);
+        if(isMoved(a, first) || isMoved(a, second)){
+            unlockPair(a, first, second);
+            continue;
+        }
+        for(size_t i = 0; i < NEIGHBORHOOD; i++){
+            slot* sl = &a->slots[(home + i) & (a->capacity - 1)];
+            if(slotMatches(sl, h, key, keyLen)){
+                atomic_store_explicit(&sl->hash, 0, memory_order_relaxed);
+                atomic_fetch_sub(&table->count, 1);
+                break;
+            }
+        }
+        unlockPair(a, first, second);
+        return;
+    }
+}
+
+void freeHashTable(hashTable* table){
+    slotArray* a = atomic_load(&table->current);
+    while(a != NULL){
+        slotArray* next = atomic_load(&a->next);
+        freeSlotArray(a);
+        a = next;
+    }
+    while(table->retired != NULL){
+        slotArray* next = table->retired->retiredNext;
+        freeSlotArray(table->retired);
+        table->retired = next;
+    }
+    pthread_mutex_destroy(&table->resizeLock);
+    free(table);
+}
+
+
+#define WRITERS 4
+#define READERS 4
+#define KEYS_PER_WRITER 100000
+
+hashTable* sharedTable;
+
+void* writer(void* arg){
+    long id = (long)arg;
+    char key[KEY_SIZE];
+    for(int i = 0; i < KEYS_PER_WRITER; i++){
+        sprintf(key, "w%ld-%d", id, i);
+        insert(sharedTable, key, i);
+    }
+    // delete every fourth key again
+    for(int i = 0; i < KEYS_PER_WRITER; i += 4){
+        sprintf(key, "w%ld-%d", id, i);
+        delete(sharedTable, key);
+    }
+    return NULL;
+}
+
+void* reader(void* arg){
+    (void)arg;
+    long hits = 0;
+    char key[KEY_SIZE];
+    int value;
+    for(int round = 0; round < 4; round++){
+        for(int i = 0; i < KEYS_PER_WRITER; i++){
+            sprintf(key, "w%d-%d", i % WRITERS, i);
+            if(pop(sharedTable, key, &value)){
+                if(value != i){
+                    printf("wrong value for %s: %d\n", key, value);
+                }
+                ++hits;
+            }
+        }
+    }
+    return (void*)hits;
+}
+
+
+int main(int argc, char* argv[]){
+    sharedTable = newHashTable();
+
+    pthread_t threads[WRITERS + READERS];
+    for(long t = 0; t < WRITERS; t++){
+        pthread_create(&threads[t], NULL, writer, (void*)t);
+    }
+    for(long t = 0; t < READERS; t++){
+        pthread_create(&threads[WRITERS + t], NULL, reader, NULL);
+    }
+    for(int t = 0; t < WRITERS + READERS; t++){
+        void* res;
+        pthread_join(threads[t], &res);
+        if(t >= WRITERS){
+            printf("reader %d: %ld hits\n", t - WRITERS, (long)res);
+        }
+    }
+
+    long missing = 0;
+    char key[KEY_SIZE];
+    int value;
+    for(int w = 0; w < WRITERS; w++){
+        for(int i = 0; i < KEYS_PER_WRITER; i++){
+            sprintf(key, "w%d-%d", w, i);
+            int found = pop(sharedTable, key, &value);
+            if(found != (i % 4 != 0) || (found && value != i)){
+                ++missing;
+            }
+        }
+    }
+    slotArray* cur = atomic_load(&sharedTable->current);
+    printf("count = %ld, capacity = %zu, wrong lookups = %ld\n",
+           (long)atomic_load(&sharedTable->count), cur->capacity, missing);
+
+    freeHashTable(sharedTable);
+}
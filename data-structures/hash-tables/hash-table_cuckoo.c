@@ -0,0 +1,381 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "hash-functions.h"
+#include "key-store.h"
+
+// Cuckoo hashing with 4-way buckets.
+// Every key has exactly two candidate buckets, b1(k) and b2(k), taken from two independent halves of
+// its 64-bit hash, and every bucket has SLOTS_PER_BUCKET = 4 slots. A key is always stored in one of its
+// two buckets, so a lookup reads at most two buckets: worst-case O(1), unlike the probing schemes of
+// hash-tables_theory.c, whose worst case is a long probe sequence.
+// Insertion puts the key into a free slot of b1 or b2. If both are full, some key must move to
+// its other bucket (it is "kicked out", like a cuckoo chick), possibly kicking out another one, and so on.
+// Instead of kicking at random, we look for the shortest such chain with a breadth-first search over
+// buckets (at most MAX_BFS_NODES buckets), and only then perform the moves, from the end of the chain.
+// With 4-way buckets this succeeds up to ~95% occupancy. If no chain exists, the key is put
+// into a small "stash", which every lookup also checks (only when it is not empty); when the stash is
+// full as well, the table doubles.
+//
+// Optional tag filter (CUCKOO_TAGS, on by default): besides the slots there is a compact array with
+// one byte per slot holding 8 bits of the hash of the key stored there (0 marks an empty slot).
+// The 4 tags of a bucket are compared with the tag of the searched key at once, as one 32-bit word
+// (SIMD within a register), and only the slots whose tag matches are looked at. For a miss that
+// usually means reading just two 4-byte words.
+//
+// Keys are not malloc()'ed one by one, which would add a third dependent cache miss to a hit: a slot
+// holds its key in a keyRef (see key-store.h), so keys of up to 15 bytes are compared inside the
+// slot, and only longer ones are read from the table's keyStore (compacted by delete() once deleted
+// keys fill half of it). Together with the cached hash, which is compared first, a lookup of a short
+// key reads at most its two buckets.
+
+#define SLOTS_PER_BUCKET 4
+#define INITIAL_BUCKETS 4        // must be a power of two
+#define MAX_BFS_NODES 256
+#define STASH_SIZE 4
+
+#ifndef CUCKOO_TAGS
+#define CUCKOO_TAGS 1
+#endif
+
+typedef struct Slot{
+    keyRef key;
+    uint64_t hash;       // cached, so moving a key never rehashes it
+    int data;
+    int used;            // 0 means that the slot is empty
+} slot;
+
+typedef struct HashTable{
+    slot* slots;         // bucket b occupies slots[4b .. 4b + 3]
+    uint8_t* tags;       // one tag per slot, only when CUCKOO_TAGS is on
+    size_t bucketMask;   // number of buckets - 1
+    size_t count;        // keys in the buckets and in the stash
+    slot stash[STASH_SIZE];
+    int stashCount;
+    uint64_t seed;
+    keyStore keys;       // the keys longer than KEY_INLINE_MAX
+} hashTable;
+
+typedef struct BfsNode{
+    size_t bucket;
+    int parent;          // index of the node whose key moves into this bucket, -1 for b1/b2
+    int parentSlot;      // slot of that key in the parent's bucket
+} bfsNode;
+
+
+size_t bucket1(hashTable* table, uint64_t h){
+    return h & table->bucketMask;
+}
+
+size_t bucket2(hashTable* table, uint64_t h){
+    size_t b = (h >> 32) & table->bucketMask;
+    return b != bucket1(table, h) ? b : (b + 1) & table->bucketMask;
+}
+
+uint8_t tagOf(uint64_t h){
+    uint8_t t = h >> 56;
+    return t != 0 ? t : 1;
+}
+
+void initBuckets(hashTable* table, size_t buckets){
+    table->slots = calloc(buckets * SLOTS_PER_BUCKET, sizeof(slot));
+#if CUCKOO_TAGS
+    table->tags = calloc(buckets * SLOTS_PER_BUCKET, 1);
+#else
+    table->tags = NULL;
+#endif
+    table->bucketMask = buckets - 1;
+}
+
+hashTable* newHashTable(){
+    hashTable* table = malloc(sizeof(hashTable));
+    initBuckets(table, INITIAL_BUCKETS);
+    table->count = 0;
+    table->stashCount = 0;
+    table->seed = hashSeed();
+    keyStoreInit(&table->keys);
+    return table;
+}
+
+void setSlot(hashTable* table, size_t b, int i, slot s){
+    table->slots[b * SLOTS_PER_BUCKET + i] = s;
+#if CUCKOO_TAGS
+    table->tags[b * SLOTS_PER_BUCKET + i] = s.used ? tagOf(s.hash) : 0;
+#endif
+}
+
+int freeSlotInBucket(hashTable* table, size_t b){
+    for(int i = 0; i < SLOTS_PER_BUCKET; i++){
+        if(!table->slots[b * SLOTS_PER_BUCKET + i].used){
+            return i;
+        }
+    }
+    return -1;
+}
+
+int slotMatches(hashTable* table, const slot* s, const char* key, size_t keyLen, uint64_t h){
+    return s->used && s->hash == h && keyRefEquals(&table->keys, &s->key, key, keyLen);
+}
+
+// Index of key's slot in bucket b, or -1
+int findInBucket(hashTable* table, size_t b, const char* key, size_t keyLen, uint64_t h){
+#if CUCKOO_TAGS
+    uint32_t word;
+    memcpy(&word, table->tags + b * SLOTS_PER_BUCKET, 4);
+    uint32_t x = word ^ (tagOf(h) * 0x01010101u);     // a zero byte where the tag matches
+    uint32_t m = (x - 0x01010101u) & ~x & 0x80808080u;  // high bit of each zero byte (may over-report)
+    for(; m != 0; m &= m - 1){
+        int i = __builtin_ctz(m) / 8;
+        if(slotMatches(table, &table->slots[b * SLOTS_PER_BUCKET + i], key, keyLen, h)){
+            return i;
+        }
+    }
+#else
+    for(int i = 0; i < SLOTS_PER_BUCKET; i++){
+        if(slotMatches(table, &table->slots[b * SLOTS_PER_BUCKET + i], key, keyLen, h)){
+            return i;
+        }
+    }
+#endif
+    return -1;
+}
+
+// Pointer to key's slot (in a bucket or in the stash), or NULL
+slot* find(hashTable* table, const char* key, size_t keyLen, uint64_t h){
+    size_t b = bucket1(table, h);
+    int i = findInBucket(table, b, key, keyLen, h);
+    if(i < 0){
+        b = bucket2(table, h);
+        i = findInBucket(table, b, key, keyLen, h);
+    }
+    if(i >= 0){
+        return &table->slots[b * SLOTS_PER_BUCKET + i];
+    }
+    for(int k = 0; k < table->stashCount; k++){
+        if(slotMatches(table, &table->stash[k], key, keyLen, h)){
+            return &table->stash[k];
+        }
+    }
+    return NULL;
+}
+
+// Breadth-first search for the shortest chain of moves that frees a slot in b1 or b2 of s,
+// then places s. Returns 0 if no chain of at most MAX_BFS_NODES buckets exists.
+int placeSlot(hashTable* table, slot s){
+    size_t b1 = bucket1(table, s.hash), b2 = bucket2(table, s.hash);
+    int i = freeSlotInBucket(table, b1);
+    if(i >= 0){
+        setSlot(table, b1, i, s);
+        return 1;
+    }
+    i = freeSlotInBucket(table, b2);
+    if(i >= 0){
+        setSlot(table, b2, i, s);
+        return 1;
+    }
+
+    bfsNode queue[MAX_BFS_NODES];
+    int head = 0, tail = 0;
+    queue[tail++] = (bfsNode){b1, -1, -1};
+    queue[tail++] = (bfsNode){b2, -1, -1};
+    while(head < tail){
+        int cur = head++;
+        size_t b = queue[cur].bucket;
+        for(int k = 0; k < SLOTS_PER_BUCKET; k++){
+            slot* victim = &table->slots[b * SLOTS_PER_BUCKET + k];
+            size_t alt = bucket1(table, victim->hash) == b ? bucket2(table, victim->hash) : bucket1(table, victim->hash);
+            int freeSlot = freeSlotInBucket(table, alt);
+            if(freeSlot >= 0){
+                // walk the chain back to b1/b2, every key moves into the slot freed by the previous move
+                setSlot(table, alt, freeSlot, *victim);
+                size_t freedBucket = b;
+                int freedSlot = k;
+                for(int n = cur; queue[n].parent >= 0; n = queue[n].parent){
+                    bfsNode* node = &queue[n];
+                    size_t from = queue[node->parent].bucket;
+                    setSlot(table, freedBucket, freedSlot, table->slots[from * SLOTS_PER_BUCKET + node->parentSlot]);
+                    freedBucket = from;
+                    freedSlot = node->parentSlot;
+                }
+                setSlot(table, freedBucket, freedSlot, s);
+                return 1;
+            }
+            int seen = 0;
+            for(int n = 0; n < tail && !seen; n++){
+                seen = queue[n].bucket == alt;
+            }
+            if(!seen && tail < MAX_BFS_NODES){
+                queue[tail++] = (bfsNode){alt, cur, k};
+            }
+        }
+    }
+    return 0;
+}
+
+void grow(hashTable* table){
+    slot* old = table->slots;
+    size_t oldSlots = (table->bucketMask + 1) * SLOTS_PER_BUCKET;
+    size_t buckets = table->bucketMask + 1;
+    for(;;){
+        buckets *= 2;
+        free(table->tags);
+        initBuckets(table, buckets);
+        int ok = 1;
+        for(size_t i = 0; i < oldSlots && ok; i++){
+            if(old[i].used){
+                ok = placeSlot(table, old[i]);
+            }
+        }
+        for(int k = 0; k < table->stashCount && ok; k++){
+            ok = placeSlot(table, table->stash[k]);
+        }
+        if(ok){
+            break;
+        }
+        free(table->slots);   // extremely unlikely: try an even bigger table
+    }
+    table->stashCount = 0;
+    free(old);
+}
+
+void insert(hashTable* table, const char* key, int value){
+    size_t keyLen = strlen(key);
+    uint64_t h = hashString(key, keyLen, table->seed);
+    slot* found = find(table, key, keyLen, h);
+    if(found != NULL){
+        found->data = value;
+        return;
+    }
+    slot s;
+    s.key = keyStoreAdd(&table->keys, key, keyLen);
+    s.hash = h;
+    s.data = value;
+    s.used = 1;
+    ++(table->count);
+    if(placeSlot(table, s)){
+        return;
+    }
+    if(table->stashCount < STASH_SIZE){
+        table->stash[table->stashCount++] = s;
+        return;
+    }
+    grow(table);
+    if(!placeSlot(table, s)){
+        table->stash[table->stashCount++] = s;
+    }
+}
+
+int pop(hashTable* table, const char* key){
+    size_t keyLen = strlen(key);
+    slot* found = find(table, key, keyLen, hashString(key, keyLen, table->seed));
+    if(found == NULL){
+        printf("No such element found. Exit status: ");
+        return EXIT_FAILURE;
+    }
+    return found->data;
+}
+
+// Copies the keys of the buckets and the stash to a fresh store, leaving out the deleted ones
+void compactKeys(hashTable* table){
+    keyStore fresh;
+    keyStoreInit(&fresh);
+    for(size_t i = 0; i < (table->bucketMask + 1) * SLOTS_PER_BUCKET; ++i){
+        if(table->slots[i].used){
+            keyStoreRelocate(&fresh, &table->keys, &table->slots[i].key);
+        }
+    }
+    for(int k = 0; k < table->stashCount; k++){
+        keyStoreRelocate(&fresh, &table->keys, &table->stash[k].key);
+    }
+    keyStoreReplace(&table->keys, &fresh);
+}
+
+void delete(hashTable* table, const char* key){
+    size_t keyLen = strlen(key);
+    uint64_t h = hashString(key, keyLen, table->seed);
+    slot* found = find(table, key, keyLen, h);
+    if(found == NULL){
+        printf("No such element found\n");
+        return;
+    }
+    keyStoreRelease(&table->keys, &found->key);
+    --(table->count);
+    if(found >= table->stash && found < table->stash + STASH_SIZE){
+        *found = table->stash[--(table->stashCount)];
+    }
+    else{
+        size_t i = found - table->slots;
+        slot empty;
+        memset(&empty, 0, sizeof(empty));
+        setSlot(table, i / SLOTS_PER_BUCKET, i % SLOTS_PER_BUCKET, empty);
+        // a slot was freed, maybe a stashed key fits now
+        for(int k = 0; k < table->stashCount; k++){
+            if(placeSlot(table, table->stash[k])){
+                table->stash[k--] = table->stash[--(table->stashCount)];
+            }
+        }
+    }
+    if(keyStoreNeedsCompaction(&table->keys)){
+        compactKeys(table);
+    }
+}
+
+void dump(hashTable* table){
+    for(size_t b = 0; b <= table->bucketMask; ++b){
+        for(int i = 0; i < SLOTS_PER_BUCKET; i++){
+            slot* s = &table->slots[b * SLOTS_PER_BUCKET + i];
+            if(s->used){
+                printf("bucket[%4zu][%d]: %.*s = %d\n", b, i, (int)keyRefLen(&s->key), keyRefBytes(&table->keys, &s->key),
+                       s->data);
+            }
+        }
+    }
+    for(int k = 0; k < table->stashCount; k++){
+        slot* s = &table->stash[k];
+        printf("stash[%d]: %.*s = %d\n", k, (int)keyRefLen(&s->key), keyRefBytes(&table->keys, &s->key), s->data);
+    }
+}
+
+void freeHashTable(hashTable* table){
+    keyStoreFree(&table->keys);
+    free(table->slots);
+    free(table->tags);
+    free(table);
+}
+
+
+int main(int argc, char* argv[]){
+
+    hashTable* myTable = newHashTable();
+
+    insert(myTable, "amir", 17);
+    insert(myTable, "azin", 24);
+    insert(myTable, "aZMZ", 42);
+    insert(myTable, "munisa", 26);
+    dump(myTable);
+
+    printf("\n%d\n", pop(myTable, "aZMZ"));
+    printf("%d", pop(myTable, "adsaa"));
+    printf("\n\n");
+
+    delete(myTable, "azin");
+    dump(myTable);
+
+    // occupancy of the buckets reached before the table had to grow (small tables aside)
+    char key[16];
+    double maxLoad = 0;
+    for(int i = 0; i < 100000; ++i){
+        size_t capacity = (myTable->bucketMask + 1) * SLOTS_PER_BUCKET;
+        double load = (double)(myTable->count - myTable->stashCount) / capacity;
+        if(capacity >= 1024 && load > maxLoad){
+            maxLoad = load;
+        }
+        sprintf(key, "key%d", i);
+        insert(myTable, key, i);
+    }
+    printf("\ncount = %zu, slots = %zu, highest load before a resize = %.3f\n",
+           myTable->count, (myTable->bucketMask + 1) * SLOTS_PER_BUCKET, maxLoad);
+
+    freeHashTable(myTable);
+}
@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "hash-functions.h"
+
+// Hash maps specialized for integer keys and fixed-size (plain old data) values.
+// The tables in the other files take "const char*" keys, so integer ids would have to be formatted
+// as strings first, copied with malloc() + strcpy() and compared with memcmp().
+// DEFINE_INT_HASH_MAP(name, keyType, valueType) instead generates a whole map type for one
+// key/value pair of types, like a C++ template would:
+//  typedef ... name;
+//  name* nameNew(void);
+//  void  nameInsert(name* map, keyType key, valueType value);
+//  int   nameGet(name* map, keyType key, valueType* value);   // 1 if found
+//  int   nameDelete(name* map, keyType key);                   // 1 if found
+//  void  nameFree(name* map);
+// Keys and values are stored side by side in one flat array of entries, so nothing is allocated per
+// key, and a probe reads the key and value from the same entry: one cache line for most keys.
+// The key 0 marks an empty entry, so an entry is just a key and a value, with no flag next to them
+// (a flag byte would make an entry of a 4-byte key and an 8-byte value 24 bytes instead of 16).
+// Key 0 itself can still be stored: the map keeps its value in a field of its own.
+// The hash is the multiplication method (multiplyShift() from hash-functions.h, one multiplication
+// and one shift, with a random odd multiplier per map), and keys are compared with ==.
+// Collisions are resolved by linear probing, the table doubles when it becomes 3/4 full, and
+// deletion shifts the following entries back (Knuth's Algorithm R), so there are no tombstones.
+
+#define INT_MAP_INITIAL_BITS 4   // 16 entries
+
+#define DEFINE_INT_HASH_MAP(name, keyType, valueType)                                       \
+                                                                                            \
+typedef struct name##Entry{                                                                 \
+    keyType key;             /* 0 means that the entry is empty */                          \
+    valueType value;                                                                        \
+} name##Entry;                                                                              \
+                                                                                            \
+typedef struct name{                                                                        \
+    name##Entry* entries;                                                                   \
+    unsigned int bits;       /* capacity is 2^bits */                                       \
+    size_t count;            /* key 0 included */                                           \
+    uint64_t multiplier;     /* random and odd */                                           \
+    int hasZero;             /* key 0 is in the map, with zeroValue */                      \
+    valueType zeroValue;                                                                    \
+} name;                                                                                     \
+                                                                                            \
+static inline size_t name##Home(const name* map, keyType key){                              \
+    return multiplyShift((uint64_t)key, map->multiplier, map->bits);                        \
+}                                                                                           \
+                                                                                            \
+static inline name* name##NewWithBits(unsigned int bits, uint64_t multiplier){              \
+    name* map = malloc(sizeof(name));                                                       \
+    map->entries = calloc((size_t)1 << bits, sizeof(name##Entry));                          \
+    map->bits = bits;                                                                       \
+    map->count = 0;                                                                         \
+    map->multiplier = multiplier;                                                           \
+    map->hasZero = 0;                                                                       \
+    return map;                                                                             \
+}                                                                                           \
+                                                                                            \
+static inline name* name##New(void){                                                        \
+    return name##NewWithBits(INT_MAP_INITIAL_BITS, hashSeed() | 1);                         \
+}                                                                                           \
+                                                                                            \
+static inline void name##Free(name* map){                                                   \
+    free(map->entries);                                                                     \
+    free(map);                                                                              \
+}                                                                                           \
+                                                                                            \
+/* index of key's entry, or of the empty entry where it would go; key != 0 */               \
+static inline size_t name##Find(const name* map, keyType key){                              \
+    size_t mask = ((size_t)1 << map->bits) - 1;                                             \
+    size_t i = name##Home(map, key);                                                        \
+    while(map->entries[i].key != 0 && map->entries[i].key != key){                          \
+        i = (i + 1) & mask;                                                                 \
+    }                                                                                       \
+    return i;                                                                               \
+}                                                                                           \
+                                                                                            \
+static inline void name##Grow(name* map){                                                   \
+    name##Entry* old = map->entries;                                                        \
+    size_t oldCapacity = (size_t)1 << map->bits;                                            \
+    ++(map->bits);                                                                          \
+    map->entries = calloc((size_t)1 << map->bits, sizeof(name##Entry));                     \
+    for(size_t i = 0; i < oldCapacity; i++){                                                \
+        if(old[i].key != 0){                                                                \
+            map->entries[name##Find(map, old[i].key)] = old[i];                             \
+        }                                                                                   \
+    }                                                                                       \
+    free(old);                                                                              \
+}                                                                                           \
+                                                                                            \
+static inline void name##Insert(name* map, keyType key, valueType value){                   \
+    if(key == 0){                                                                           \
+        map->count += !map->hasZero;                                                        \
+        map->hasZero = 1;                                                                   \
+        map->zeroValue = value;                                                             \
+        return;                                                                             \
+    }                                                                                       \
+    size_t i = name##Find(map, key);                                                        \
+    if(map->entries[i].key == 0){                                                           \
+        if((map->count + 1) * 4 > ((size_t)3 << map->bits)){                                \
+            name##Grow(map);                                                                \
+            i = name##Find(map, key);                                                       \
+        }                                                                                   \
+        map->entries[i].key = key;                                                          \
+        ++(map->count);                                                                     \
+    }                                                                                       \
+    map->entries[i].value = value;                                                          \
+}                                                                                           \
+                                                                                            \
+static inline int name##Get(const name* map, keyType key, valueType* value){                \
+    if(key == 0){                                                                           \
+        if(map->hasZero){                                                                   \
+            *value = map->zeroValue;                                                        \
+        }                                                                                   \
+        return map->hasZero;                                                                \
+    }                                                                                       \
+    size_t i = name##Find(map, key);                                                        \
+    if(map->entries[i].key == 0){                                                           \
+        return 0;                                                                           \
+    }                                                                                       \
+    *value = map->entries[i].value;                                                         \
+    return 1;                                                                               \
+}                                                                                           \
+                                                                                            \
+static inline int name##Delete(name* map, keyType key){                                     \
+    if(key == 0){                                                                           \
+        if(!map->hasZero){                                                                  \
+            return 0;                                                                       \
+        }                                                                                   \
+        map->hasZero = 0;                                                                   \
+        --(map->count);                                                                     \
+        return 1;                                                                           \
+    }                                                                                       \
+    size_t mask = ((size_t)1 << map->bits) - 1;                                             \
+    size_t i = name##Find(map, key);                                                        \
+    if(map->entries[i].key == 0){                                                           \
+        return 0;                                                                           \
+    }                                                                                       \
+    /* move back every following entry whose home is not in (i, j] */                       \
+    for(size_t j = (i + 1) & mask; map->entries[j].key != 0; j = (j + 1) & mask){           \
+        size_t home = name##Home(map, map->entries[j].key);                                 \
+        if(((j - home) & mask) >= ((j - i) & mask)){                                        \
+            map->entries[i] = map->entries[j];                                              \
+            i = j;                                                                          \
+        }                                                                                   \
+    }                                                                                       \
+    map->entries[i].key = 0;                                                                \
+    --(map->count);                                                                         \
+    return 1;                                                                               \
+}
+
+
+// id -> index maps for 64-bit and 32-bit ids
+DEFINE_INT_HASH_MAP(idMap, uint64_t, uint32_t)
+DEFINE_INT_HASH_MAP(smallIdMap, uint32_t, double)
+
+
+int main(int argc, char* argv[]){
+
+    idMap* ids = idMapNew();
+    for(uint32_t i = 0; i < 1000000; i++){
+        idMapInsert(ids, 0x9000000000ULL + 7ULL * i, i);
+    }
+    for(uint32_t i = 0; i < 1000000; i += 2){
+        idMapDelete(ids, 0x9000000000ULL + 7ULL * i);
+    }
+    uint32_t index;
+    printf("count = %zu, capacity = %zu\n", ids->count, (size_t)1 << ids->bits);
+    printf("%d ", idMapGet(ids, 0x9000000000ULL + 7ULL * 4, &index));
+    if(idMapGet(ids, 0x9000000000ULL + 7ULL * 5, &index)){
+        printf("%u\n", index);
+    }
+    idMapFree(ids);
+
+    smallIdMap* prices = smallIdMapNew();
+    smallIdMapInsert(prices, 17, 1.5);
+    smallIdMapInsert(prices, 42, 2.25);
+    smallIdMapInsert(prices, 17, 3.0);
+    double price;
+    if(smallIdMapGet(prices, 17, &price)){
+        printf("%u -> %.2f\n", 17, price);
+    }
+    printf("%d\n", smallIdMapGet(prices, 18, &price));
+    smallIdMapFree(prices);
+}
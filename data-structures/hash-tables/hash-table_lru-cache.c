@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hash-functions.h"
+#include "key-store.h"
+#include "../linked-lists/intrusive-list.h"
+
+// LRU (least recently used) cache: a hash table of at most "capacity" keys which, when it is full
+// and a new key comes, evicts the key that was used the longest time ago.
+//
+// It is the chained hash table of hash-table_with_chaining.c plus a recency list, both intrusive
+// (see intrusive-list.h): every entry has one listLink in the chain of its bucket and one in the
+// recency list, where the most recently used entry is first and the next one to evict is last.
+//  get - find the entry in its chain, move it to the front of the recency list, O(1) expected;
+//  put - update the entry the same way, or take a free entry (or evict the last one) and link it in;
+//  evicting takes the last entry of the recency list and unlinks it from its chain, O(1), since
+//  the chains are doubly linked and no search is needed.
+// All "capacity" entries are allocated once, in one array, when the cache is created, and unused
+// entries wait on a free list, so get, put and evict never call malloc or free. The keys are kept in
+// keyRefs (see key-store.h): short keys inside the entry, long ones in the cache's keyStore, which is
+// rebuilt when more than half of it belongs to evicted keys, so it does not grow without bound.
+// There are as many buckets as entries (rounded up to a power of two), so chains stay short;
+// the bucket of a key is its hash & bucketMask, and the hash is kept in the entry so that chains are
+// compared by hash first and nothing needs to be rehashed.
+
+typedef struct LruEntry{
+    listLink chain;       // in its bucket's chain
+    listLink recency;     // in the recency list, or in the free list when unused
+    uint64_t hash;
+    keyRef key;
+    int data;
+} lruEntry;
+
+typedef struct LruCache{
+    lruEntry* entries;    // capacity entries, allocated once
+    size_t capacity, count;
+    listLink* buckets;
+    size_t bucketMask;
+    listLink recency;     // most recently used first
+    listLink unused;
+    uint64_t seed;        // random per cache, see hash-functions.h
+    keyStore keys;
+    unsigned long hits, misses, evictions;
+} lruCache;
+
+
+lruCache* newLruCache(size_t capacity){
+    lruCache* cache = malloc(sizeof(lruCache));
+    cache->capacity = capacity;
+    cache->count = 0;
+    cache->entries = malloc(sizeof(lruEntry) * capacity);
+    size_t buckets = 1;
+    while(buckets < capacity){
+        buckets *= 2;
+    }
+    cache->buckets = malloc(sizeof(listLink) * buckets);
+    cache->bucketMask = buckets - 1;
+    for(size_t i = 0; i < buckets; i++){
+        listInit(&cache->buckets[i]);
+    }
+    listInit(&cache->recency);
+    listInit(&cache->unused);
+    for(size_t i = 0; i < capacity; i++){
+        listPushBack(&cache->unused, &cache->entries[i].recency);
+    }
+    cache->seed = hashSeed();
+    keyStoreInit(&cache->keys);
+    cache->hits = cache->misses = cache->evictions = 0;
+    return cache;
+}
+
+void freeLruCache(lruCache* cache){
+    keyStoreFree(&cache->keys);
+    free(cache->buckets);
+    free(cache->entries);
+    free(cache);
+}
+
+lruEntry* lruFind(lruCache* cache, const char* key, size_t keyLen, uint64_t h){
+    listLink* bucket = &cache->buckets[h & cache->bucketMask];
+    listForEach(it, bucket){
+        lruEntry* entry = containerOf(it, lruEntry, chain);
+        if(entry->hash == h && keyRefEquals(&cache->keys, &entry->key, key, keyLen)){
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Copies the keys of the cached entries to a new store, leaving out the evicted ones
+void compactKeys(lruCache* cache){
+    keyStore fresh;
+    keyStoreInit(&fresh);
+    listForEach(it, &cache->recency){
+        keyStoreRelocate(&fresh, &cache->keys, &containerOf(it, lruEntry, recency)->key);
+    }
+    keyStoreReplace(&cache->keys, &fresh);
+}
+
+// Unlinks an entry from its chain and the recency list and puts it on the free list
+void releaseEntry(lruCache* cache, lruEntry* entry){
+    listRemove(&entry->chain);
+    listRemove(&entry->recency);
+    listPushFront(&cache->unused, &entry->recency);
+    keyStoreRelease(&cache->keys, &entry->key);
+    --(cache->count);
+}
+
+// Returns 0 if key is not cached; a hit makes key the most recently used
+int lruGet(lruCache* cache, const char* key, int* value){
+    size_t keyLen = strlen(key);
+    lruEntry* entry = lruFind(cache, key, keyLen, hashString(key, keyLen, cache->seed));
+    if(entry == NULL){
+        ++(cache->misses);
+        return 0;
+    }
+    ++(cache->hits);
+    listMoveToFront(&cache->recency, &entry->recency);
+    *value = entry->data;
+    return 1;
+}
+
+// Inserts or updates key as the most recently used; returns 1 if another key was evicted for it
+int lruPut(lruCache* cache, const char* key, int value){
+    if(cache->capacity == 0){
+        return 0;
+    }
+    size_t keyLen = strlen(key);
+    uint64_t h = hashString(key, keyLen, cache->seed);
+    lruEntry* entry = lruFind(cache, key, keyLen, h);
+    if(entry != NULL){
+        entry->data = value;
+        listMoveToFront(&cache->recency, &entry->recency);
+        return 0;
+    }
+
+    int evicted = 0;
+    if(listEmpty(&cache->unused)){
+        releaseEntry(cache, containerOf(cache->recency.prev, lruEntry, recency));
+        ++(cache->evictions);
+        evicted = 1;
+    }
+    if(keyStoreNeedsCompaction(&cache->keys)){
+        compactKeys(cache);
+    }
+    entry = containerOf(listPopFront(&cache->unused), lruEntry, recency);
+    entry->hash = h;
+    entry->key = keyStoreAdd(&cache->keys, key, keyLen);
+    entry->data = value;
+    listPushFront(&cache->buckets[h & cache->bucketMask], &entry->chain);
+    listPushFront(&cache->recency, &entry->recency);
+    ++(cache->count);
+    return evicted;
+}
+
+// Returns 0 if key was not cached
+int lruDelete(lruCache* cache, const char* key){
+    size_t keyLen = strlen(key);
+    lruEntry* entry = lruFind(cache, key, keyLen, hashString(key, keyLen, cache->seed));
+    if(entry == NULL){
+        return 0;
+    }
+    releaseEntry(cache, entry);
+    return 1;
+}
+
+// Empties the cache: the whole recency list goes to the free list with one splice
+void lruClear(lruCache* cache){
+    for(size_t i = 0; i <= cache->bucketMask; i++){
+        listInit(&cache->buckets[i]);
+    }
+    listSplice(&cache->unused, &cache->recency);
+    keyStoreFree(&cache->keys);
+    cache->count = 0;
+}
+
+void dumpLruCache(lruCache* cache){
+    printf("Most recent: ");
+    listForEach(it, &cache->recency){
+        lruEntry* entry = containerOf(it, lruEntry, recency);
+        printf("%.*s=%d ", (int)keyRefLen(&entry->key), keyRefBytes(&cache->keys, &entry->key), entry->data);
+    }
+    printf(":Least recent\n");
+}
+
+
+int main(int argc, char* argv[]){
+    lruCache* cache = newLruCache(4);
+
+    lruPut(cache, "Bob", 10);
+    lruPut(cache, "Alice", 20);
+    lruPut(cache, "Jack", 30);
+    lruPut(cache, "a key that is longer than fifteen bytes", 40);
+    dumpLruCache(cache);
+
+    int value;
+    if(lruGet(cache, "Bob", &value)){   // Bob is now the most recent, Alice the least
+        printf("Bob: %d\n", value);
+    }
+    lruPut(cache, "Jane", 50);          // evicts Alice
+    dumpLruCache(cache);
+    printf("Alice cached: %d\n", lruGet(cache, "Alice", &value));
+    lruDelete(cache, "Jack");
+    lruPut(cache, "Alice", 60);         // takes Jack's entry, nothing is evicted
+    dumpLruCache(cache);
+    printf("hits %lu, misses %lu, evictions %lu\n", cache->hits, cache->misses, cache->evictions);
+
+    lruClear(cache);
+    dumpLruCache(cache);
+    freeLruCache(cache);
+}
@@ -1,141 +1,454 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hash-functions.h"
+#include "key-store.h"
+#include "hash-table-stats.h"
 
-#define CAPACITY 701
+// The probe sequence is pluggable (see hash-tables_theory.c for the analysis):
+//  LINEAR_PROBING     h(k, i) = (h'(k) + i) mod m, simple but suffers from primary clustering;
+//  QUADRATIC_PROBING  h(k, i) = (h'(k) + i(i + 1)/2) mod m, quadratic probing with c = d = 1/2;
+//                     with m a power of two these "triangular numbers" visit every slot;
+//  DOUBLE_HASHING     h(k, i) = (h1(k) + i*h2(k)) mod m, where h2(k) is forced to be odd,
+//                     so it is relatively prime to m = 2^p and the whole table is searched.
+// h1 and h2 are two halves of one 64-bit hashString() value, which is computed once per operation;
+// every probe is then only an addition and a mask.
+// A deleted slot is marked with deleteMe = 1 (a tombstone): searches continue past it, and insert()
+// reuses the first tombstone on the key's probe sequence.
+// The table counts probes, so the strategies can be compared on a real workload (probeStats());
+// with -DHASH_TABLE_STATS it also keeps a histogram of them, see hash-table-stats.h and statsReport().
+// Keys are not malloc()'ed one by one: short keys live inside the slot and long ones in the table's
+// keyStore (see key-store.h), which delete() compacts once deleted keys fill half of it.
+//
+// Table files (saveHashTable(), mapHashTable(), mappedLookup()).
+// Building a big table from the source data at every start of a program is slow. A table can instead
+// be built once and saved; the file is a tableFileHeader (magic, version, seed, probe strategy,
+// capacity, count, offsets), then the flat array of all capacity slots, then the key store with the
+// live long keys. Slots refer to keys by offsets (keyRef), not pointers, so nothing has to be fixed up:
+// mapHashTable() mmap()s the file read-only and mappedLookup() probes the mapped slots directly,
+// with the seed and strategy from the header. Opening takes a few system calls whatever the size,
+// pages are read in only when a lookup touches them, and all processes mapping the same file share
+// one copy in the page cache. Tombstones are saved as they are, since they keep probe sequences intact.
+// The file uses the byte order and struct layout of the machine that wrote it; a file with another
+// magic, version or slot size is rejected, and so is one whose offsets and sizes do not fit in the file.
+// The slots are not checked when the file is mapped, as that would read all of them; instead
+// mappedLookup() checks that the key of a slot lies inside the key store before comparing it,
+// so a corrupt or truncated file can give wrong answers but never makes a lookup read outside the mapping.
+// The file has the fixed capacity of the table it was saved from (CAPACITY slots).
+
+#define CAPACITY 1024   // must be a power of two
+
+typedef enum ProbeStrategy{
+    LINEAR_PROBING,
+    QUADRATIC_PROBING,
+    DOUBLE_HASHING
+} probeStrategy;
 
 typedef struct Slot{
+    keyRef key;
+    int data;
     int deleteMe;
-    char *key;
-    int data;         
 } slot;
 
 typedef struct HashTable{
     slot** entries;
+    uint64_t seed;    // random per table, see hash-functions.h
+    probeStrategy probing;
+    keyStore keys;
+
+    unsigned long operations;    // insert/delete/pop calls
+    unsigned long probes;        // slots examined by them
+    unsigned int longestProbe;
+    STATS_FIELD
 } hashTable;
 
-hashTable* newHashTable(){
+hashTable* newHashTableWithProbing(probeStrategy probing){
     hashTable* table = malloc(sizeof(hashTable));
     table->entries = malloc(sizeof(slot*) * CAPACITY);
     for(int i = 0; i < CAPACITY; i++){
         table->entries[i] = NULL;
     }
+    table->seed = hashSeed();
+    table->probing = probing;
+    keyStoreInit(&table->keys);
+    table->operations = table->probes = 0;
+    table->longestProbe = 0;
+    STATS_INIT(table);
 
     return table;
 }
 
-// Simple linear probing
-unsigned int hash(const char* key, int trialCount){
-    unsigned long int value = 0;
-    unsigned int i = 0;
-    unsigned int key_len = strlen(key);
-    for(; i < key_len; ++i){
-        value = value * 37 + key[i];
+hashTable* newHashTable(){
+    return newHashTableWithProbing(LINEAR_PROBING);
+}
+
+// h is the hash of the key, computed once per operation with hashString()
+unsigned int probeSlot(probeStrategy probing, uint64_t h, unsigned int trialCount, unsigned int mask){
+    unsigned int h1 = (unsigned int)h;
+    switch(probing){
+    case QUADRATIC_PROBING:
+        return (h1 + trialCount * (trialCount + 1) / 2) & mask;
+    case DOUBLE_HASHING:
+        return (h1 + trialCount * ((unsigned int)(h >> 32) | 1)) & mask;
+    default:
+        return (h1 + trialCount) & mask;
     }
-    value = (value + trialCount) % CAPACITY;
+}
+
+unsigned int hash(hashTable* table, uint64_t h, unsigned int trialCount){
+    return probeSlot(table->probing, h, trialCount, CAPACITY - 1);
+}
+
+void countProbes(hashTable* table, unsigned int probes){
+    ++(table->operations);
+    table->probes += probes;
+    if(probes > table->longestProbe){
+        table->longestProbe = probes;
+    }
+    STATS_PROBE(table, probes);
+}
 
-    return value;
+int keyEquals(hashTable* table, const slot* entry, const char* key, size_t keyLen){
+    return keyRefEquals(&table->keys, &entry->key, key, keyLen);
+}
+
+// Index of key's slot, or -1
+int findSlot(hashTable* table, const char* key, size_t keyLen, uint64_t h){
+    for(unsigned int i = 0; i < CAPACITY; i++){
+        slot* entry = table->entries[hash(table, h, i)];
+        if(entry == NULL){
+            countProbes(table, i + 1);
+            return -1;
+        }
+        if(!entry->deleteMe && keyEquals(table, entry, key, keyLen)){
+            countProbes(table, i + 1);
+            return hash(table, h, i);
+        }
+    }
+    countProbes(table, CAPACITY);
+    return -1;
+}
+
+// Stores key at index, reusing the slot if it is a tombstone
+void fillSlot(hashTable* table, unsigned int index, const char* key, size_t keyLen, int value){
+    slot* entry = table->entries[index];
+    if(entry == NULL){
+        entry = malloc(sizeof(slot));
+        table->entries[index] = entry;
+    }
+    entry->key = keyStoreAdd(&table->keys, key, keyLen);
+    entry->data = value;
+    entry->deleteMe = 0;
 }
 
 void insert(hashTable* table, const char* key, int value){
-    unsigned int hashedKey;
-    int i = 0;
-    for(; i <= CAPACITY; i++){
-        hashedKey = hash(key, i);
-        if(table->entries[hashedKey] == NULL){
-            slot* newSlot = malloc(sizeof(slot));
-            newSlot->key = malloc(strlen(key) + 1);
-            strcpy(newSlot->key, key);
-            newSlot->data = value;
-            newSlot->deleteMe = 0;   
-            table->entries[hashedKey] = newSlot;
+    size_t keyLen = strlen(key);
+    uint64_t h = hashString(key, keyLen, table->seed);
+    int tombstone = -1;
+    for(unsigned int i = 0; i < CAPACITY; i++){
+        unsigned int hashedKey = hash(table, h, i);
+        slot* entry = table->entries[hashedKey];
+        if(entry == NULL){
+            countProbes(table, i + 1);
+            fillSlot(table, tombstone >= 0 ? (unsigned int)tombstone : hashedKey, key, keyLen, value);
             return;
         }
-        else if(strcmp(table->entries[hashedKey]->key, key) == 0){
-            table->entries[hashedKey]->data = value;
+        if(entry->deleteMe){
+            if(tombstone < 0){
+                tombstone = hashedKey;   // the key may still be further on, keep looking
+            }
+        }
+        else if(keyEquals(table, entry, key, keyLen)){
+            countProbes(table, i + 1);
+            entry->data = value;
             return;
         }
+    }
+    countProbes(table, CAPACITY);
+    if(tombstone >= 0){
+        fillSlot(table, tombstone, key, keyLen, value);
+        return;
+    }
+    printf("Hash Table Overflow\n");
+}
+
+// Copies the live keys to a fresh store; tombstones get an empty inline key, so none points to the old one
+void compactKeys(hashTable* table){
+    keyStore fresh;
+    keyStoreInit(&fresh);
+    for(int i = 0; i < CAPACITY; i++){
+        slot* entry = table->entries[i];
+        if(entry == NULL){
+            continue;
+        }
+        if(entry->deleteMe){
+            memset(&entry->key, 0, sizeof(keyRef));
+        }
         else{
-            table->entries[hashedKey]->deleteMe = 1;
+            keyStoreRelocate(&fresh, &table->keys, &entry->key);
         }
     }
-    printf("Hash Table Overflow\n");
+    keyStoreReplace(&table->keys, &fresh);
 }
 
 void delete(hashTable* table, const char* key){
-    int i = 0;
-    for(; i <= CAPACITY; i++){
-        if(table->entries[hash(key, i)] != NULL && table->entries[hash(key, i)]->deleteMe == 1){
-            if(strcmp(table->entries[hash(key, i)]->key, key) == 0){
-                free(table->entries[hash(key, i)]->key);
-                free(table->entries[hash(key, i)]);
-                table->entries[hash(key, i)] = NULL;
-                return;
-            }
-            else{
-                continue;
-            }
+    size_t keyLen = strlen(key);
+    int i = findSlot(table, key, keyLen, hashString(key, keyLen, table->seed));
+    if(i < 0){
+        printf("No such element found\n");
+        return;
+    }
+    keyStoreRelease(&table->keys, &table->entries[i]->key);
+    table->entries[i]->deleteMe = 1;
+    if(keyStoreNeedsCompaction(&table->keys)){
+        compactKeys(table);
+    }
+}
+
+int pop(hashTable* table, const char* key){
+    size_t keyLen = strlen(key);
+    int i = findSlot(table, key, keyLen, hashString(key, keyLen, table->seed));
+    if(i < 0){
+        printf("No such element found. Exit status: ");
+        return EXIT_FAILURE;
+    }
+    return table->entries[i]->data;
+}
+
+void probeStats(hashTable* table){
+    printf("operations: %lu, average probe length: %.2f, longest probe: %u\n", table->operations,
+           table->operations ? (double)table->probes / table->operations : 0.0, table->longestProbe);
+}
+
+#define TABLE_FILE_MAGIC 0x5448414fu   // "OAHT"
+#define TABLE_FILE_VERSION 1
+
+#define FILE_SLOT_EMPTY 0
+#define FILE_SLOT_FULL 1
+#define FILE_SLOT_DELETED 2
+
+typedef struct TableFileHeader{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t seed;
+    uint32_t probing;
+    uint32_t capacity;       // power of two
+    uint32_t count;
+    uint32_t slotSize;       // sizeof(fileSlot)
+    uint64_t slotsOffset;    // from the start of the file
+    uint64_t keysOffset;
+    uint64_t keysSize;
+} tableFileHeader;
+
+typedef struct FileSlot{
+    keyRef key;
+    int32_t data;
+    uint32_t state;
+} fileSlot;
+
+typedef struct MappedTable{
+    void* base;
+    size_t size;
+    const tableFileHeader* header;
+    const fileSlot* slots;
+    keyStore keys;           // points into the mapping, never written
+} mappedTable;
+
+// Writes the table to path; returns 0, or -1 if the file could not be written
+int saveHashTable(hashTable* table, const char* path){
+    tableFileHeader header = {0};
+    fileSlot* slots = calloc(CAPACITY, sizeof(fileSlot));
+    keyStore keys;   // only the live keys are saved
+    keyStoreInit(&keys);
+    for(int i = 0; i < CAPACITY; i++){
+        slot* entry = table->entries[i];
+        if(entry == NULL){
+            continue;
+        }
+        if(entry->deleteMe){
+            slots[i].state = FILE_SLOT_DELETED;
+            continue;
         }
-        else if(table->entries[hash(key, i)] != NULL && table->entries[hash(key, i)]->deleteMe == 0){
+        slots[i].key = keyStoreAdd(&keys, keyRefBytes(&table->keys, &entry->key), keyRefLen(&entry->key));
+        slots[i].data = entry->data;
+        slots[i].state = FILE_SLOT_FULL;
+        ++(header.count);
+    }
+    header.magic = TABLE_FILE_MAGIC;
+    header.version = TABLE_FILE_VERSION;
+    header.seed = table->seed;
+    header.probing = table->probing;
+    header.capacity = CAPACITY;
+    header.slotSize = sizeof(fileSlot);
+    header.slotsOffset = sizeof(tableFileHeader);
+    header.keysOffset = header.slotsOffset + (uint64_t)CAPACITY * sizeof(fileSlot);
+    header.keysSize = keys.used;
 
-            free(table->entries[hash(key, i)]->key);
-            free(table->entries[hash(key, i)]);
-            table->entries[hash(key, i)] = NULL;
-            return;
+    int ok = 0;
+    FILE* f = fopen(path, "wb");
+    if(f != NULL){
+        ok = fwrite(&header, sizeof(header), 1, f) == 1
+             && fwrite(slots, sizeof(fileSlot), CAPACITY, f) == CAPACITY
+             && fwrite(keys.bytes, 1, keys.used, f) == keys.used;
+        ok = fclose(f) == 0 && ok;
+    }
+    free(slots);
+    keyStoreFree(&keys);
+    if(!ok){
+        printf("Could not write %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+// Whether the header describes a table that lies inside a file of fileSize bytes
+int validTableHeader(const tableFileHeader* header, uint64_t fileSize){
+    if(header->magic != TABLE_FILE_MAGIC || header->version != TABLE_FILE_VERSION
+       || header->slotSize != sizeof(fileSlot) || header->probing > DOUBLE_HASHING
+       || header->capacity == 0 || (header->capacity & (header->capacity - 1)) != 0){
+        return 0;
+    }
+    // the subtractions below cannot wrap, and capacity * sizeof(fileSlot) is never computed if too big
+    if(header->slotsOffset < sizeof(tableFileHeader) || header->slotsOffset % _Alignof(fileSlot) != 0
+       || header->slotsOffset > fileSize
+       || header->capacity > (fileSize - header->slotsOffset) / sizeof(fileSlot)){
+        return 0;
+    }
+    uint64_t slotsEnd = header->slotsOffset + (uint64_t)header->capacity * sizeof(fileSlot);
+    return header->keysOffset >= slotsEnd && header->keysOffset <= fileSize
+           && header->keysSize <= fileSize - header->keysOffset;
+}
+
+// Whether the key of a mapped slot is inline or lies inside the mapped key store, with its length there
+int validFileKey(const mappedTable* table, const keyRef* key){
+    if(key->bytes[KEY_INLINE_MAX] != KEY_IN_STORE){
+        return key->bytes[KEY_INLINE_MAX] <= KEY_INLINE_MAX;
+    }
+    uint64_t start = (uint64_t)key->stored.offset * KEY_ALIGN;
+    if(key->stored.len <= KEY_INLINE_MAX || start + sizeof(uint32_t) + key->stored.len > table->keys.used){
+        return 0;
+    }
+    uint32_t len;
+    memcpy(&len, table->keys.bytes + start, sizeof(len));
+    return len == key->stored.len;
+}
+
+// Maps a file written by saveHashTable(); returns NULL if it cannot be opened or is not a table file
+mappedTable* mapHashTable(const char* path){
+    int fd = open(path, O_RDONLY);
+    if(fd < 0){
+        printf("Could not open %s\n", path);
+        return NULL;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(tableFileHeader)){
+        printf("%s is not a hash table file\n", path);
+        close(fd);
+        return NULL;
+    }
+    void* base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);   // the mapping stays valid
+    if(base == MAP_FAILED){
+        printf("Could not map %s\n", path);
+        return NULL;
+    }
+    const tableFileHeader* header = base;
+    if(!validTableHeader(header, st.st_size)){
+        printf("%s is not a hash table file\n", path);
+        munmap(base, st.st_size);
+        return NULL;
+    }
+    mappedTable* table = malloc(sizeof(mappedTable));
+    table->base = base;
+    table->size = st.st_size;
+    table->header = header;
+    table->slots = (const fileSlot*)((const char*)base + header->slotsOffset);
+    keyStoreInit(&table->keys);
+    table->keys.bytes = (char*)base + header->keysOffset;
+    table->keys.used = table->keys.size = header->keysSize;
+
+    return table;
+}
+
+// 1 and *value = the key's value if key is in the mapped table, 0 otherwise
+int mappedLookup(const mappedTable* table, const char* key, int* value){
+    size_t keyLen = strlen(key);
+    uint64_t h = hashString(key, keyLen, table->header->seed);
+    unsigned int capacity = table->header->capacity;
+    for(unsigned int i = 0; i < capacity; i++){
+        const fileSlot* s = &table->slots[probeSlot(table->header->probing, h, i, capacity - 1)];
+        if(s->state == FILE_SLOT_EMPTY){
+            return 0;
         }
-        else{
-            printf("No such element found\n");
-            return;
+        if(s->state == FILE_SLOT_FULL && validFileKey(table, &s->key)
+           && keyRefEquals(&table->keys, &s->key, key, keyLen)){
+            *value = s->data;
+            return 1;
         }
     }
+    return 0;
 }
 
-int pop(hashTable* table, const char* key){
-    int i = 0;
-    for(; i <= CAPACITY; i++){
-        if(table->entries[hash(key, i)] != NULL && table->entries[hash(key, i)]->deleteMe == 1){
-            if(strcmp(table->entries[hash(key, i)]->key, key) == 0){
-                return table->entries[hash(key, i)]->data;
-            }
-            else{
-                continue;
-            }
+void unmapHashTable(mappedTable* table){
+    munmap(table->base, table->size);
+    free(table);
+}
+
+#ifdef HASH_TABLE_STATS
+hashTableReport statsReport(hashTable* table){
+    hashTableReport report;
+    memset(&report, 0, sizeof(report));
+    report.counters = table->stats;
+    report.capacity = CAPACITY;
+    size_t slots = 0;
+    for(int i = 0; i < CAPACITY; i++){
+        slot* entry = table->entries[i];
+        if(entry == NULL){
+            continue;
         }
-        else if(table->entries[hash(key, i)] != NULL && table->entries[hash(key, i)]->deleteMe == 0){
-            return table->entries[hash(key, i)]->data;
+        ++slots;
+        if(entry->deleteMe){
+            ++report.tombstones;
         }
         else{
-            printf("No such element found. Exit status: ");
-            return EXIT_FAILURE;
+            ++report.count;
         }
     }
+    report.loadFactor = (double)report.count / CAPACITY;
+    size_t bytes = sizeof(hashTable) + sizeof(slot*) * CAPACITY + slots * (sizeof(slot) + STATS_MALLOC_OVERHEAD)
+                   + table->keys.size;
+    report.bytesPerEntry = report.count ? (double)bytes / report.count : 0.0;
+    return report;
 }
+#endif
 
 void dump(hashTable* table){
     for (int i = 0; i < CAPACITY; ++i) {
         slot* entry = table->entries[i];
 
-        if (entry == NULL) {
+        if (entry == NULL || entry->deleteMe) {
             continue;
         }
 
         printf("slot[%4d]: ", i);
 
-        printf("%s = %d ", entry->key, entry->data);
+        printf("%.*s = %d ", (int)keyRefLen(&entry->key), keyRefBytes(&table->keys, &entry->key), entry->data);
 
         printf("\n");
     }
 }
 
-// Search() subroutine can be implemented using the logic, like in delete() or pop() above
-
 int main(int argc, char* argv[]){
     
     hashTable* myTable = newHashTable();
 
     insert(myTable, "amir", 17);
-    insert(myTable, "azin", 24);   // hashed key is 1
-    insert(myTable, "aZMZ", 42);   // hashed key is also 1
+    insert(myTable, "azin", 24);   // with the old "value * 37 + key[i]" hash these two
+    insert(myTable, "aZMZ", 42);   // collided in slot 1
     insert(myTable, "munisa", 26);
     dump(myTable);
 
@@ -152,4 +465,47 @@ int main(int argc, char* argv[]){
     // insert(myTable, "aZMZ", 42);
     dump(myTable);
 
+    // the same workload with every probe strategy at ~80% load
+    const char* names[] = {"linear", "quadratic", "double hashing"};
+    char key[64];
+    for(int p = LINEAR_PROBING; p <= DOUBLE_HASHING; p++){
+        hashTable* t = newHashTableWithProbing(p);
+        for(int i = 0; i < CAPACITY * 8 / 10; i++){
+            snprintf(key, sizeof key, "key%d", i);
+            insert(t, key, i);
+        }
+        t->operations = t->probes = t->longestProbe = 0;
+        for(int i = 0; i < CAPACITY; i++){
+            snprintf(key, sizeof key, "key%d", i);   // the last ~20% are misses
+            findSlot(t, key, strlen(key), hashString(key, strlen(key), t->seed));
+        }
+        printf("\n%s: ", names[p]);
+        probeStats(t);
+#ifdef HASH_TABLE_STATS
+        hashTableReport report = statsReport(t);
+        statsPrintJson(stdout, &report);
+#endif
+    }
+
+    // save the double hashing table, then query the file without loading it
+    hashTable* t = newHashTableWithProbing(DOUBLE_HASHING);
+    for(int i = 0; i < CAPACITY / 2; i++){
+        snprintf(key, sizeof key, i % 2 ? "key%d" : "a rather long key number %d", i);
+        insert(t, key, i);
+    }
+    delete(t, "key7");
+    if(saveHashTable(t, "table.bin") == 0){
+        mappedTable* mapped = mapHashTable("table.bin");
+        if(mapped != NULL){
+            int value = 0;
+            int found = mappedLookup(mapped, "a rather long key number 100", &value);
+            printf("\nmapped %u keys: %d %d, ", mapped->header->count, found, value);
+            found = mappedLookup(mapped, "key9", &value);
+            printf("%d %d, ", found, value);
+            printf("%d\n", mappedLookup(mapped, "key7", &value));
+            unmapHashTable(mapped);
+        }
+        remove("table.bin");
+    }
+
 }
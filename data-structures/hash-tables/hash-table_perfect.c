@@ -0,0 +1,433 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "hash-functions.h"
+
+// Minimal perfect hashing for key sets that never change (PTHash style).
+// A minimal perfect hash function maps the n keys of a fixed set one-to-one onto 0..n-1. With it the
+// values can be kept in a plain array of n values, and a lookup is: hash the key, read one small
+// "pilot", compute the position, read the value. There is no probing, and the keys are not stored
+// at all, so there is nothing to compare them with: a key that is not in the set is mapped to
+// the position of some key that is. An optional 8-bit fingerprint per position catches 255 of 256
+// such keys.
+//
+// Construction (Pibiri and Trani, "PTHash", 2021):
+//  the keys are split into about n / LAMBDA buckets by one hash, and into m = n / ALPHA slots
+//  (ALPHA = 0.99) by another hash mixed with a per-bucket pilot p: slot = h(key, p) mod m.
+//  Buckets are processed from the biggest to the smallest; for every bucket the pilots
+//  p = 0, 1, 2, ... are tried until all its keys land in free slots, different from each other.
+//  The bucket hash is skewed (60% of the keys go to 30% of the buckets), so the big buckets are
+//  placed while the table is still empty, and the many small ones fill it up.
+//  Slots >= n are remapped to the slots < n left free (remap[], about (1 - ALPHA) n entries),
+//  which makes the function minimal.
+// Most pilots are small, so they are kept in one byte each; the rare pilot >= PILOT_ESCAPE is stored
+// as PILOT_ESCAPE plus an entry in a small sorted overflow array of the bucket's partition.
+// With LAMBDA = 3.5 this costs 8 / 3.5 = 2.3 bits per key for the pilots, 0.3 for remap[] and a few
+// tenths for the overflow arrays, about 3.2 bits per key in total.
+//
+// Parallel build: the keys are first split into partitions of about KEYS_PER_PARTITION keys by
+// the top bits of their hash. Every partition is an independent function over its own range of
+// positions, so the partitions are built by "threads" threads at once. A partition that cannot be
+// built (no pilot below MAX_PILOT for some bucket) is retried with another pilot seed; when that
+// fails too the keys were most likely not distinct.
+
+#define LAMBDA_NUM 7                  // average bucket size 7/2
+#define LAMBDA_DEN 2
+#define ALPHA_PERCENT 99              // load factor of the slots before remapping
+#define DENSE_KEYS 0x9999999999999999ULL   // 0.6 * 2^64: the hashes that go to the dense buckets
+#define DENSE_BUCKETS_PERCENT 30
+#define PILOT_ESCAPE 255
+#define MAX_PILOT (1u << 20)
+#define MAX_ATTEMPTS 8
+#define KEYS_PER_PARTITION 100000
+
+typedef struct PilotOverflow{
+    uint32_t bucket;
+    uint32_t pilot;
+} pilotOverflow;
+
+typedef struct Partition{
+    size_t offset;                // keys in the earlier partitions, the first position of this one
+    uint32_t n, m;                // keys and slots, slots >= n are remapped
+    uint32_t buckets, denseBuckets;
+    uint64_t pilotSeed;
+    size_t pilotBase;             // the partition's part of pilots[]
+    size_t remapBase;             // and of remap[]
+    pilotOverflow* overflow;      // sorted by bucket
+    uint32_t overflowCount;
+} partition;
+
+typedef struct PerfectHash{
+    uint64_t seed;
+    size_t n;
+    unsigned int partitionCount;
+    partition* partitions;
+    uint8_t* pilots;
+    uint32_t* remap;
+    int* values;                  // values[position]
+    uint8_t* fingerprints;        // NULL when built without them
+} perfectHash;
+
+
+// floor(x * n / 2^64), a fair value in 0..n-1 without a division
+uint64_t fastRange(uint64_t x, uint64_t n){
+    return (uint64_t)(((__uint128_t)x * n) >> 64);
+}
+
+uint32_t bucketOf(const partition* p, uint64_t h){
+    uint64_t hb = fmix64(h ^ 0x9e3779b97f4a7c15ULL);
+    uint64_t r = (hb << 32) | (hb >> 32);   // bits independent of the dense/sparse choice
+    if(hb < DENSE_KEYS){
+        return fastRange(r, p->denseBuckets);
+    }
+    return p->denseBuckets + fastRange(r, p->buckets - p->denseBuckets);
+}
+
+uint32_t slotOf(const partition* p, uint64_t h, uint32_t pilot){
+    return fastRange(fmix64(h ^ fmix64(pilot + p->pilotSeed)), p->m);
+}
+
+uint32_t overflowPilot(const partition* p, uint32_t bucket){
+    uint32_t low = 0, high = p->overflowCount;
+    while(low < high){
+        uint32_t mid = (low + high) / 2;
+        if(p->overflow[mid].bucket < bucket){
+            low = mid + 1;
+        }
+        else{
+            high = mid;
+        }
+    }
+    return p->overflow[low].pilot;
+}
+
+// Position of key in 0..n-1; -1 if the fingerprint shows that key is not in the set.
+// Without fingerprints every key gets a position
+long perfectHashPosition(const perfectHash* ph, const char* key, size_t keyLen){
+    uint64_t h = hashString(key, keyLen, ph->seed);
+    const partition* p = &ph->partitions[fastRange(h, ph->partitionCount)];
+    if(p->n == 0){
+        return -1;
+    }
+    uint32_t b = bucketOf(p, h);
+    uint32_t pilot = ph->pilots[p->pilotBase + b];
+    if(pilot == PILOT_ESCAPE){
+        pilot = overflowPilot(p, b);
+    }
+    uint32_t s = slotOf(p, h, pilot);
+    if(s >= p->n){
+        s = ph->remap[p->remapBase + s - p->n];
+    }
+    size_t position = p->offset + s;
+    if(ph->fingerprints != NULL && ph->fingerprints[position] != (uint8_t)h){
+        return -1;
+    }
+    return position;
+}
+
+// 1 and *value = key's value, or 0 if key is known not to be in the set
+int perfectHashGet(const perfectHash* ph, const char* key, int* value){
+    long position = perfectHashPosition(ph, key, strlen(key));
+    if(position < 0){
+        return 0;
+    }
+    *value = ph->values[position];
+    return 1;
+}
+
+int compareOverflow(const void* a, const void* b){
+    uint32_t x = ((const pilotOverflow*)a)->bucket, y = ((const pilotOverflow*)b)->bucket;
+    return (x > y) - (x < y);
+}
+
+// Finds the pilots of one partition; hashes[i] is the hash of the key with index keyIndex[i].
+// Returns 0 if some bucket has no pilot below MAX_PILOT
+int buildPartition(perfectHash* ph, partition* p, const uint64_t* hashes, const uint32_t* keyIndex,
+                   const int* values){
+    uint32_t n = p->n, m = p->m;
+    uint32_t* itemBucket = malloc(sizeof(uint32_t) * n);
+    uint32_t* bucketStart = calloc(p->buckets + 1, sizeof(uint32_t));
+    uint32_t* items = malloc(sizeof(uint32_t) * n);           // item numbers grouped by bucket
+    uint32_t* itemSlot = malloc(sizeof(uint32_t) * n);
+    uint8_t* taken = calloc(m, 1);
+    uint32_t maxSize = 0;
+
+    // counting sort of the items by bucket
+    for(uint32_t i = 0; i < n; i++){
+        itemBucket[i] = bucketOf(p, hashes[i]);
+        ++bucketStart[itemBucket[i] + 1];
+    }
+    for(uint32_t b = 0; b < p->buckets; b++){
+        if(bucketStart[b + 1] > maxSize){
+            maxSize = bucketStart[b + 1];
+        }
+        bucketStart[b + 1] += bucketStart[b];
+    }
+    uint32_t* fill = malloc(sizeof(uint32_t) * p->buckets);
+    memcpy(fill, bucketStart, sizeof(uint32_t) * p->buckets);
+    for(uint32_t i = 0; i < n; i++){
+        items[fill[itemBucket[i]]++] = i;
+    }
+
+    // and of the buckets by size, biggest first
+    uint32_t* sizeStart = calloc(maxSize + 2, sizeof(uint32_t));
+    uint32_t* order = malloc(sizeof(uint32_t) * p->buckets);
+    for(uint32_t b = 0; b < p->buckets; b++){
+        ++sizeStart[maxSize - (bucketStart[b + 1] - bucketStart[b]) + 1];
+    }
+    for(uint32_t s = 0; s <= maxSize; s++){
+        sizeStart[s + 1] += sizeStart[s];
+    }
+    for(uint32_t b = 0; b < p->buckets; b++){
+        order[sizeStart[maxSize - (bucketStart[b + 1] - bucketStart[b])]++] = b;
+    }
+
+    uint32_t overflowSize = 0;
+    p->overflow = NULL;
+    p->overflowCount = 0;
+    int ok = 1;
+    for(uint32_t k = 0; k < p->buckets && ok; k++){
+        uint32_t b = order[k];
+        uint32_t first = bucketStart[b], size = bucketStart[b + 1] - first;
+        uint32_t pilot = 0;
+        for(; size > 0 && pilot < MAX_PILOT; pilot++){
+            uint32_t placed = 0;
+            for(; placed < size; placed++){
+                uint32_t item = items[first + placed];
+                uint32_t s = slotOf(p, hashes[item], pilot);
+                if(taken[s]){
+                    break;
+                }
+                taken[s] = 1;
+                itemSlot[item] = s;
+            }
+            if(placed == size){
+                break;
+            }
+            while(placed-- > 0){
+                taken[itemSlot[items[first + placed]]] = 0;
+            }
+        }
+        if(pilot == MAX_PILOT){
+            ok = 0;
+        }
+        else if(pilot >= PILOT_ESCAPE){
+            if(p->overflowCount == overflowSize){
+                overflowSize = overflowSize ? overflowSize * 2 : 16;
+                p->overflow = realloc(p->overflow, sizeof(pilotOverflow) * overflowSize);
+            }
+            p->overflow[p->overflowCount].bucket = b;
+            p->overflow[p->overflowCount].pilot = pilot;
+            ++(p->overflowCount);
+            ph->pilots[p->pilotBase + b] = PILOT_ESCAPE;
+        }
+        else{
+            ph->pilots[p->pilotBase + b] = pilot;
+        }
+    }
+
+    if(ok){
+        if(p->overflowCount > 0){
+            qsort(p->overflow, p->overflowCount, sizeof(pilotOverflow), compareOverflow);
+        }
+        // every taken slot >= n gets one of the free slots < n
+        uint32_t q = 0;
+        for(uint32_t s = n; s < m; s++){
+            uint32_t* r = &ph->remap[p->remapBase + s - n];
+            *r = 0;
+            if(taken[s]){
+                while(taken[q]){
+                    q++;
+                }
+                *r = q++;
+            }
+        }
+        for(uint32_t i = 0; i < n; i++){
+            uint32_t s = itemSlot[i];
+            if(s >= n){
+                s = ph->remap[p->remapBase + s - n];
+            }
+            ph->values[p->offset + s] = values[keyIndex[i]];
+            if(ph->fingerprints != NULL){
+                ph->fingerprints[p->offset + s] = (uint8_t)hashes[i];
+            }
+        }
+    }
+    else{
+        free(p->overflow);
+        p->overflow = NULL;
+        p->overflowCount = 0;
+    }
+    free(itemBucket);
+    free(bucketStart);
+    free(items);
+    free(itemSlot);
+    free(taken);
+    free(fill);
+    free(sizeStart);
+    free(order);
+    return ok;
+}
+
+typedef struct BuildJob{
+    perfectHash* ph;
+    const uint64_t* hashes;       // grouped by partition
+    const uint32_t* keyIndex;
+    const int* values;
+    atomic_uint next;             // next partition to build
+    atomic_int failed;
+} buildJob;
+
+void* buildPartitions(void* arg){
+    buildJob* job = arg;
+    unsigned int i;
+    while((i = atomic_fetch_add(&job->next, 1)) < job->ph->partitionCount && !atomic_load(&job->failed)){
+        partition* p = &job->ph->partitions[i];
+        int built = 0;
+        for(int attempt = 0; attempt < MAX_ATTEMPTS && !built; attempt++){
+            p->pilotSeed = fmix64(job->ph->seed + i * 0x9e3779b97f4a7c15ULL + attempt);
+            built = buildPartition(job->ph, p, job->hashes + p->offset, job->keyIndex + p->offset, job->values);
+        }
+        if(!built){
+            atomic_store(&job->failed, 1);
+        }
+    }
+    return NULL;
+}
+
+void freePerfectHash(perfectHash* ph){
+    for(unsigned int i = 0; i < ph->partitionCount; i++){
+        free(ph->partitions[i].overflow);
+    }
+    free(ph->partitions);
+    free(ph->pilots);
+    free(ph->remap);
+    free(ph->values);
+    free(ph->fingerprints);
+    free(ph);
+}
+
+// Builds the function for n distinct keys with "threads" threads; values[i] is the value of keys[i].
+// Returns NULL if it cannot be built
+perfectHash* newPerfectHash(const char* keys[], const int values[], size_t n, int threads, int withFingerprints){
+    perfectHash* ph = malloc(sizeof(perfectHash));
+    ph->seed = hashSeed();
+    ph->n = n;
+    ph->partitionCount = n / KEYS_PER_PARTITION + 1;
+    ph->partitions = calloc(ph->partitionCount, sizeof(partition));
+
+    uint64_t* keyHashes = malloc(sizeof(uint64_t) * n);
+    for(size_t i = 0; i < n; i++){
+        keyHashes[i] = hashString(keys[i], strlen(keys[i]), ph->seed);
+        ++(ph->partitions[fastRange(keyHashes[i], ph->partitionCount)].n);
+    }
+    size_t offset = 0, pilotBase = 0, remapBase = 0;
+    for(unsigned int i = 0; i < ph->partitionCount; i++){
+        partition* p = &ph->partitions[i];
+        p->offset = offset;
+        p->m = ((uint64_t)p->n * 100 + ALPHA_PERCENT - 1) / ALPHA_PERCENT;
+        if(p->m == 0){
+            p->m = 1;
+        }
+        p->buckets = ((uint64_t)p->n * LAMBDA_DEN + LAMBDA_NUM - 1) / LAMBDA_NUM + 2;
+        p->denseBuckets = p->buckets * DENSE_BUCKETS_PERCENT / 100 + 1;
+        p->pilotBase = pilotBase;
+        p->remapBase = remapBase;
+        offset += p->n;
+        pilotBase += p->buckets;
+        remapBase += p->m - p->n;
+    }
+    ph->pilots = malloc(pilotBase);
+    ph->remap = malloc(sizeof(uint32_t) * remapBase + 1);
+    ph->values = malloc(sizeof(int) * n + 1);
+    ph->fingerprints = withFingerprints ? malloc(n + 1) : NULL;
+
+    // group the hashes by partition
+    uint64_t* hashes = malloc(sizeof(uint64_t) * n);
+    uint32_t* keyIndex = malloc(sizeof(uint32_t) * n);
+    size_t* fill = malloc(sizeof(size_t) * ph->partitionCount);
+    for(unsigned int i = 0; i < ph->partitionCount; i++){
+        fill[i] = ph->partitions[i].offset;
+    }
+    for(size_t i = 0; i < n; i++){
+        size_t k = fill[fastRange(keyHashes[i], ph->partitionCount)]++;
+        hashes[k] = keyHashes[i];
+        keyIndex[k] = i;
+    }
+    free(fill);
+    free(keyHashes);
+
+    buildJob job = {ph, hashes, keyIndex, values, 0, 0};
+    if(threads < 1){
+        threads = 1;
+    }
+    pthread_t* workers = malloc(sizeof(pthread_t) * threads);
+    for(int t = 1; t < threads; t++){
+        pthread_create(&workers[t], NULL, buildPartitions, &job);
+    }
+    buildPartitions(&job);
+    for(int t = 1; t < threads; t++){
+        pthread_join(workers[t], NULL);
+    }
+    free(workers);
+    free(hashes);
+    free(keyIndex);
+
+    if(atomic_load(&job.failed)){
+        printf("Could not build the perfect hash function (are the keys distinct?)\n");
+        freePerfectHash(ph);
+        return NULL;
+    }
+    return ph;
+}
+
+// Size of the function itself (pilots, overflow, remap, partitions), without values and fingerprints
+double perfectHashBitsPerKey(const perfectHash* ph){
+    size_t bytes = sizeof(perfectHash) + sizeof(partition) * ph->partitionCount;
+    for(unsigned int i = 0; i < ph->partitionCount; i++){
+        const partition* p = &ph->partitions[i];
+        bytes += p->buckets + sizeof(uint32_t) * (p->m - p->n) + sizeof(pilotOverflow) * p->overflowCount;
+    }
+    return ph->n ? 8.0 * bytes / ph->n : 0.0;
+}
+
+
+int main(int argc, char* argv[]){
+    enum { KEYS = 1000000 };
+    char (*names)[16] = malloc(sizeof(*names) * KEYS);
+    const char** keys = malloc(sizeof(char*) * KEYS);
+    int* values = malloc(sizeof(int) * KEYS);
+    for(int i = 0; i < KEYS; i++){
+        sprintf(names[i], "key%d", i);
+        keys[i] = names[i];
+        values[i] = i;
+    }
+
+    perfectHash* ph = newPerfectHash(keys, values, KEYS, 4, 1);
+    if(ph == NULL){
+        return EXIT_FAILURE;
+    }
+    printf("%zu keys in %u partitions, %.2f bits per key\n", ph->n, ph->partitionCount, perfectHashBitsPerKey(ph));
+
+    int wrong = 0, value;
+    for(int i = 0; i < KEYS; i++){
+        if(!perfectHashGet(ph, keys[i], &value) || value != i){
+            ++wrong;
+        }
+    }
+    int falsePositives = 0;
+    char key[32];
+    for(int i = 0; i < KEYS; i++){
+        sprintf(key, "missing%d", i);
+        falsePositives += perfectHashGet(ph, key, &value);
+    }
+    printf("wrong values: %d, missing keys reported as present: %.3f%%\n", wrong, 100.0 * falsePositives / KEYS);
+
+    freePerfectHash(ph);
+    free(names);
+    free(keys);
+    free(values);
+}
@@ -0,0 +1,501 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hash-functions.h"
+#include "hash-table-stats.h"
+#include "key-store.h"
+
+// Open addressing with linear probing and "Robin Hood" insertion.
+// Every entry remembers how far it sits from its home slot (its probe distance).
+// While inserting, if the entry being placed is farther from home than the entry occupying
+// the probed slot ("poorer" than it), they swap places and the displaced entry continues probing.
+// This takes from the rich and gives to the poor: the variance of probe distances becomes very small,
+// so even at 90% load the probe sequences stay short, and an unsuccessful search can stop as soon as
+// it meets an entry that is closer to its home than we would be in that slot.
+//
+// Deletion uses backward shift: the entries after the deleted one are moved one slot back until
+// an empty slot or an entry sitting in its home slot is met. Hence there are no tombstones,
+// and deletions do not make later searches longer.
+//
+// Differences from hash-table_open-addressing.c:
+//  capacity is a power of two and the table doubles when the load factor would exceed MAX_LOAD;
+//  the home slot is chosen by the multiplication method, floor(m * (h * A mod 1)) with
+//  A = (sqrt(5) - 1)/2, which for m = 2^p is just the top p bits of the 64-bit product
+//  h * 11400714819323198485;
+//  entries live directly in one flat array (no malloc per slot), and so do the keys of up to 15 bytes:
+//  an entry holds its key in a keyRef (see key-store.h), and only longer keys go to the table's
+//  keyStore, which delete() compacts once deleted keys fill half of it;
+//  the whole 64-bit hash of the key (seeded hashString() from hash-functions.h) is computed once per
+//  operation and cached in the entry, so probing compares it before the key, and growing reuses it
+//  instead of rehashing the string. A 32-bit hash would save nothing, the entry is 32 bytes either way.
+//
+// Incremental resize (setIncrementalResize(table, 1)).
+// Doubling a table with 100M entries in one go stalls that one insert for seconds. In incremental
+// mode, like the dict of Redis, growing only allocates the new array; the old one is kept beside it,
+// and every insert, pop and delete moves the next MIGRATE_STEP slots of the old array into the new one.
+// So the worst case of a single operation is bounded, not just the amortized cost.
+// While the migration is running:
+//  new keys always go to the new array, and lookups check the new array and then the old one;
+//  a slot of the old array that has been moved (or deleted) keeps its probe distance but its key is
+//  marked KEY_MOVED,
+//  so the early exit of Robin Hood searches in the old array is still valid. The old array only
+//  shrinks, so it needs no backward shifts and is freed as a whole when the migration is done.
+// With MIGRATE_STEP >= 2 the migration of a table with capacity m is over after at most m/2 operations,
+// before the new array (capacity 2m, holding at most 0.9m + m/2 keys) could need to grow again.
+//
+// Batches (lookupBatch(), insertBatch()).
+// In a table much bigger than the cache nearly every lookup waits for one cache miss on its home
+// slot, and a loop of pop() calls waits for these misses one after another. The batch functions work
+// on groups of BATCH_GROUP keys: first every key of the group is hashed and its home slot is
+// prefetched, then the keys are resolved in a second pass. By then the slots are (mostly) in the
+// cache, so the misses of the whole group overlap instead of being paid one by one ("group prefetching").
+//
+// With -DHASH_TABLE_STATS lookups record their probe lengths and grow() counts the resizes,
+// see hash-table-stats.h and statsReport().
+
+#define INITIAL_CAPACITY 16             // must be a power of two
+#define MAX_LOAD_NUM 9                  // grow when count > capacity * 9/10
+#define MAX_LOAD_DEN 10
+#define MIGRATE_STEP 4                  // old slots moved per operation in incremental mode
+#define BATCH_GROUP 16                  // keys whose slots are prefetched together
+#define KEY_MOVED 0xFE                  // bytes[15] of the key of a moved old slot: no length, not KEY_IN_STORE
+
+typedef struct Entry{
+    keyRef key;
+    uint64_t hash;
+    int data;
+    unsigned int dist;   // probe distance + 1, 0 means that the slot is empty
+} entry;
+
+// In the old array of an incremental resize, whether the slot's key has been moved or deleted
+int isMoved(const entry* e){
+    return e->key.bytes[KEY_INLINE_MAX] == KEY_MOVED;
+}
+
+void markMoved(entry* e){
+    e->key.bytes[KEY_INLINE_MAX] = KEY_MOVED;
+}
+
+typedef struct HashTable{
+    entry* entries;
+    unsigned int capacity;
+    unsigned int shift;   // 64 - lg(capacity)
+    unsigned int count;   // keys in both arrays
+    uint64_t seed;        // random per table
+    keyStore keys;        // the keys longer than KEY_INLINE_MAX, of both arrays
+
+    int incremental;
+    entry* oldEntries;    // NULL when no migration is running
+    unsigned int oldCapacity;
+    unsigned int oldShift;
+    unsigned int migrateIdx;
+    STATS_FIELD
+} hashTable;
+
+uint64_t hash(hashTable* table, const char* key, size_t keyLen){
+    return hashString(key, keyLen, table->seed);
+}
+
+unsigned int homeSlot(unsigned int shift, uint64_t h){
+    return (unsigned int)((h * 11400714819323198485ull) >> shift);
+}
+
+hashTable* newHashTableWithCapacity(unsigned int capacity){
+    hashTable* table = malloc(sizeof(hashTable));
+    table->entries = calloc(capacity, sizeof(entry));
+    table->capacity = capacity;
+    table->shift = 64;
+    for(; capacity > 1; capacity /= 2){
+        --(table->shift);
+    }
+    table->count = 0;
+    table->seed = hashSeed();
+    keyStoreInit(&table->keys);
+    table->incremental = 0;
+    table->oldEntries = NULL;
+    STATS_INIT(table);
+
+    return table;
+}
+
+hashTable* newHashTable(){
+    return newHashTableWithCapacity(INITIAL_CAPACITY);
+}
+
+void setIncrementalResize(hashTable* table, int on){
+    table->incremental = on;
+}
+
+// Places e into the table, which must not contain e's key yet
+void placeEntry(hashTable* table, entry e){
+    unsigned int mask = table->capacity - 1;
+    unsigned int i = homeSlot(table->shift, e.hash);
+    e.dist = 1;
+    for(;; i = (i + 1) & mask, ++e.dist){
+        entry* cur = &table->entries[i];
+        if(cur->dist == 0){
+            *cur = e;
+            return;
+        }
+        if(cur->dist < e.dist){   // cur is richer, it gives its slot away
+            entry tmp = *cur;
+            *cur = e;
+            e = tmp;
+        }
+    }
+}
+
+// Moves up to n slots of the old array into the new one, frees the old array at the end
+void migrateStep(hashTable* table, unsigned int n){
+    if(table->oldEntries == NULL){
+        return;
+    }
+    for(; n > 0 && table->migrateIdx < table->oldCapacity; --n, ++(table->migrateIdx)){
+        entry* e = &table->oldEntries[table->migrateIdx];
+        if(e->dist != 0 && !isMoved(e)){
+            placeEntry(table, *e);   // the cached hash is reused
+            markMoved(e);
+        }
+    }
+    if(table->migrateIdx == table->oldCapacity){
+        free(table->oldEntries);
+        table->oldEntries = NULL;
+    }
+}
+
+void grow(hashTable* table){
+    while(table->oldEntries != NULL){   // never happens with MIGRATE_STEP >= 2, see above
+        migrateStep(table, table->oldCapacity);
+    }
+    entry* old = table->entries;
+    unsigned int oldCapacity = table->capacity;
+    unsigned int oldShift = table->shift;
+    table->capacity *= 2;
+    --(table->shift);
+    STATS_RESIZE(table);
+    table->entries = calloc(table->capacity, sizeof(entry));
+    if(table->incremental){
+        table->oldEntries = old;
+        table->oldCapacity = oldCapacity;
+        table->oldShift = oldShift;
+        table->migrateIdx = 0;
+        return;
+    }
+    for(unsigned int i = 0; i < oldCapacity; i++){
+        if(old[i].dist != 0){
+            placeEntry(table, old[i]);   // the cached hash is reused
+        }
+    }
+    free(old);
+}
+
+// Returns the index of key's slot, or -1
+long findSlot(hashTable* table, const char* key, size_t keyLen, uint64_t h){
+    unsigned int mask = table->capacity - 1;
+    unsigned int i = homeSlot(table->shift, h);
+    for(unsigned int dist = 1;; i = (i + 1) & mask, ++dist){
+        entry* cur = &table->entries[i];
+        if(cur->dist < dist){   // empty, or key would have displaced this entry
+            STATS_PROBE(table, dist);
+            return -1;
+        }
+        if(cur->hash == h && keyRefEquals(&table->keys, &cur->key, key, keyLen)){
+            STATS_PROBE(table, dist);
+            return i;
+        }
+    }
+}
+
+// The same search in the old array of a running migration, moved slots are skipped
+long findOldSlot(hashTable* table, const char* key, size_t keyLen, uint64_t h){
+    if(table->oldEntries == NULL){
+        return -1;
+    }
+    unsigned int mask = table->oldCapacity - 1;
+    unsigned int i = homeSlot(table->oldShift, h);
+    for(unsigned int dist = 1;; i = (i + 1) & mask, ++dist){
+        entry* cur = &table->oldEntries[i];
+        if(cur->dist < dist){
+            return -1;
+        }
+        if(cur->hash == h && keyRefEquals(&table->keys, &cur->key, key, keyLen)){   // false for moved keys
+            return i;
+        }
+    }
+}
+
+// insert() without the migration step, for a key whose length and hash are known
+void insertHashed(hashTable* table, const char* key, size_t keyLen, uint64_t h, int value){
+    long i = findSlot(table, key, keyLen, h);
+    if(i >= 0){
+        table->entries[i].data = value;
+        return;
+    }
+    i = findOldSlot(table, key, keyLen, h);
+    if(i >= 0){
+        table->oldEntries[i].data = value;
+        return;
+    }
+    if((table->count + 1) * MAX_LOAD_DEN > table->capacity * MAX_LOAD_NUM){
+        grow(table);
+    }
+    entry e;
+    e.key = keyStoreAdd(&table->keys, key, keyLen);
+    e.data = value;
+    e.hash = h;
+    placeEntry(table, e);
+    ++(table->count);
+}
+
+void insert(hashTable* table, const char* key, int value){
+    migrateStep(table, MIGRATE_STEP);
+    size_t keyLen = strlen(key);
+    insertHashed(table, key, keyLen, hash(table, key, keyLen), value);
+}
+
+// Copies the keys of both arrays to a fresh store, leaving out the deleted ones
+void compactKeys(hashTable* table){
+    keyStore fresh;
+    keyStoreInit(&fresh);
+    for(unsigned int i = 0; i < table->capacity; ++i){
+        if(table->entries[i].dist != 0){
+            keyStoreRelocate(&fresh, &table->keys, &table->entries[i].key);
+        }
+    }
+    if(table->oldEntries != NULL){
+        for(unsigned int i = table->migrateIdx; i < table->oldCapacity; ++i){
+            entry* e = &table->oldEntries[i];
+            if(e->dist != 0 && !isMoved(e)){
+                keyStoreRelocate(&fresh, &table->keys, &e->key);
+            }
+        }
+    }
+    keyStoreReplace(&table->keys, &fresh);
+}
+
+void delete(hashTable* table, const char* key){
+    migrateStep(table, MIGRATE_STEP);
+    size_t keyLen = strlen(key);
+    uint64_t h = hash(table, key, keyLen);
+    long i = findSlot(table, key, keyLen, h);
+    if(i < 0){
+        i = findOldSlot(table, key, keyLen, h);
+        if(i < 0){
+            printf("No such element found\n");
+            return;
+        }
+        keyStoreRelease(&table->keys, &table->oldEntries[i].key);
+        markMoved(&table->oldEntries[i]);
+    }
+    else{
+        keyStoreRelease(&table->keys, &table->entries[i].key);
+        unsigned int mask = table->capacity - 1;
+        unsigned int next = (i + 1) & mask;
+        while(table->entries[next].dist > 1){   // not empty and not in its home slot
+            table->entries[i] = table->entries[next];
+            --(table->entries[i].dist);
+            i = next;
+            next = (next + 1) & mask;
+        }
+        table->entries[i].dist = 0;
+    }
+    --(table->count);
+    if(keyStoreNeedsCompaction(&table->keys)){
+        compactKeys(table);
+    }
+}
+
+int pop(hashTable* table, const char* key){
+    migrateStep(table, MIGRATE_STEP);
+    size_t keyLen = strlen(key);
+    uint64_t h = hash(table, key, keyLen);
+    long i = findSlot(table, key, keyLen, h);
+    if(i >= 0){
+        return table->entries[i].data;
+    }
+    i = findOldSlot(table, key, keyLen, h);
+    if(i >= 0){
+        return table->oldEntries[i].data;
+    }
+    printf("No such element found. Exit status: ");
+    return EXIT_FAILURE;
+}
+
+// Looks up keys[0..n-1]: out[i] gets the value of keys[i], found[i] (if found != NULL)
+// tells whether keys[i] is in the table. Returns the number of keys found
+size_t lookupBatch(hashTable* table, const char* keys[], size_t n, int out[], char found[]){
+    size_t lens[BATCH_GROUP];
+    uint64_t hashes[BATCH_GROUP];
+    size_t hits = 0;
+    for(size_t first = 0; first < n; first += BATCH_GROUP){
+        size_t m = n - first < BATCH_GROUP ? n - first : BATCH_GROUP;
+        migrateStep(table, MIGRATE_STEP);
+        for(size_t i = 0; i < m; ++i){
+            lens[i] = strlen(keys[first + i]);
+            hashes[i] = hash(table, keys[first + i], lens[i]);
+            __builtin_prefetch(&table->entries[homeSlot(table->shift, hashes[i])]);
+            if(table->oldEntries != NULL){
+                __builtin_prefetch(&table->oldEntries[homeSlot(table->oldShift, hashes[i])]);
+            }
+        }
+        for(size_t i = 0; i < m; ++i){
+            const char* key = keys[first + i];
+            int hit = 1;
+            long s = findSlot(table, key, lens[i], hashes[i]);
+            if(s >= 0){
+                out[first + i] = table->entries[s].data;
+            }
+            else if((s = findOldSlot(table, key, lens[i], hashes[i])) >= 0){
+                out[first + i] = table->oldEntries[s].data;
+            }
+            else{
+                hit = 0;
+            }
+            if(found != NULL){
+                found[first + i] = hit;
+            }
+            hits += hit;
+        }
+    }
+    return hits;
+}
+
+// Inserts keys[i] with values[i] for i = 0..n-1, in this order
+void insertBatch(hashTable* table, const char* keys[], const int values[], size_t n){
+    size_t lens[BATCH_GROUP];
+    uint64_t hashes[BATCH_GROUP];
+    for(size_t first = 0; first < n; first += BATCH_GROUP){
+        size_t m = n - first < BATCH_GROUP ? n - first : BATCH_GROUP;
+        migrateStep(table, MIGRATE_STEP * m);
+        for(size_t i = 0; i < m; ++i){
+            lens[i] = strlen(keys[first + i]);
+            hashes[i] = hash(table, keys[first + i], lens[i]);
+            __builtin_prefetch(&table->entries[homeSlot(table->shift, hashes[i])], 1);
+        }
+        // a grow in the middle of the group only makes the remaining prefetches useless
+        for(size_t i = 0; i < m; ++i){
+            insertHashed(table, keys[first + i], lens[i], hashes[i], values[first + i]);
+        }
+    }
+}
+
+#ifdef HASH_TABLE_STATS
+// Backward-shift deletion leaves no tombstones; a running migration counts both arrays
+hashTableReport statsReport(hashTable* table){
+    hashTableReport report;
+    memset(&report, 0, sizeof(report));
+    report.counters = table->stats;
+    report.capacity = table->capacity;
+    report.count = table->count;
+    report.loadFactor = (double)table->count / table->capacity;
+    size_t bytes = sizeof(hashTable) + sizeof(entry) * table->capacity;
+    if(table->oldEntries != NULL){
+        bytes += sizeof(entry) * table->oldCapacity;
+    }
+    bytes += table->keys.size;
+    report.bytesPerEntry = table->count ? (double)bytes / table->count : 0.0;
+    return report;
+}
+#endif
+
+void dump(hashTable* table){
+    for(unsigned int i = 0; i < table->capacity; ++i){
+        entry* e = &table->entries[i];
+        if(e->dist == 0){
+            continue;
+        }
+        printf("slot[%4u]: %.*s = %d (probe %u)\n", i, (int)keyRefLen(&e->key), keyRefBytes(&table->keys, &e->key),
+               e->data, e->dist);
+    }
+    if(table->oldEntries != NULL){
+        printf("still in the old array:\n");
+        for(unsigned int i = table->migrateIdx; i < table->oldCapacity; ++i){
+            entry* e = &table->oldEntries[i];
+            if(e->dist != 0 && !isMoved(e)){
+                printf("old[%4u]: %.*s = %d (probe %u)\n", i, (int)keyRefLen(&e->key),
+                       keyRefBytes(&table->keys, &e->key), e->data, e->dist);
+            }
+        }
+    }
+}
+
+void freeHashTable(hashTable* table){
+    free(table->oldEntries);
+    free(table->entries);
+    keyStoreFree(&table->keys);
+    free(table);
+}
+
+
+int main(int argc, char* argv[]){
+
+    hashTable* myTable = newHashTable();
+
+    insert(myTable, "amir", 17);
+    insert(myTable, "azin", 24);
+    insert(myTable, "aZMZ", 42);
+    insert(myTable, "munisa", 26);
+    dump(myTable);
+
+    printf("\n%d\n", pop(myTable, "aZMZ"));
+    printf("%d", pop(myTable, "adsaa"));
+    printf("\n\n");
+
+    delete(myTable, "azin");
+    dump(myTable);
+    printf("\n%d\n\n", pop(myTable, "aZMZ"));
+
+    // fill the table up to 90% and look at the probe distances
+    char key[16];
+    for(int i = 0; i < 1840; ++i){
+        sprintf(key, "key%d", i);
+        insert(myTable, key, i);
+    }
+    unsigned int maxDist = 0;
+    unsigned long total = 0;
+    for(unsigned int i = 0; i < myTable->capacity; ++i){
+        unsigned int d = myTable->entries[i].dist;
+        total += d;
+        if(d > maxDist){
+            maxDist = d;
+        }
+    }
+    printf("count = %u, capacity = %u, average probe = %.2f, max probe = %u\n",
+           myTable->count, myTable->capacity, (double)total / myTable->count, maxDist);
+#ifdef HASH_TABLE_STATS
+    hashTableReport report = statsReport(myTable);
+    statsPrintJson(stdout, &report);
+#endif
+
+    freeHashTable(myTable);
+
+    // the same keys with incremental resize: no insert moves more than MIGRATE_STEP old slots
+    myTable = newHashTable();
+    setIncrementalResize(myTable, 1);
+    for(int i = 0; i < 1840; ++i){
+        sprintf(key, "key%d", i);
+        insert(myTable, key, i);
+    }
+    printf("count = %u, capacity = %u, migrating = %s, key1000 = %d\n", myTable->count, myTable->capacity,
+           myTable->oldEntries != NULL ? "yes" : "no", pop(myTable, "key1000"));
+
+    freeHashTable(myTable);
+
+    // batches: the first half of the keys is inserted, then every key is looked up
+    enum { BATCH = 1000 };
+    static char names[BATCH][16];
+    const char* batchKeys[BATCH];
+    int values[BATCH], results[BATCH];
+    char found[BATCH];
+    for(int i = 0; i < BATCH; ++i){
+        sprintf(names[i], "key%d", i);
+        batchKeys[i] = names[i];
+        values[i] = i * 10;
+    }
+    myTable = newHashTable();
+    insertBatch(myTable, batchKeys, values, BATCH / 2);
+    size_t hits = lookupBatch(myTable, batchKeys, BATCH, results, found);
+    printf("found %zu of %d, key10 -> %d, key700 found = %d\n", hits, BATCH, results[10], found[700]);
+
+    freeHashTable(myTable);
+}
@@ -0,0 +1,279 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "hash-functions.h"
+#include "key-store.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Open addressing in the style of Google's SwissTable (and Facebook's F14).
+// The table is split into groups of GROUP_WIDTH = 16 slots. Besides the slots themselves
+// (key/value pairs, stored in one flat array) there is a separate array of one-byte
+// "control" values, one per slot:
+//  EMPTY   (0x80) - the slot has never been used,
+//  DELETED (0xFE) - a tombstone,
+//  0..127         - the slot is full, and the byte holds 7 bits of the key's hash (h2).
+// The rest of the hash (h1) chooses the group where probing starts.
+//
+// A whole group of 16 control bytes fits in one SSE2 register, so a single compare
+// against h2 plus a movemask gives a 16-bit mask of candidate slots; only those are compared
+// with the real key (on average 16/128 of a false candidate per probed group). The same trick with
+// EMPTY tells whether the probe sequence can stop.
+// A slot holds the whole 64-bit hash, the value and the key in a keyRef (see key-store.h): keys of up
+// to 15 bytes are stored in the slot itself, longer ones in the table's keyStore, one contiguous array.
+// A candidate is compared by its hash first, so a false h2 match costs the read of its slot and nothing
+// more. So a lookup of a short key usually reads one cache line of control bytes and one slot (32 bytes);
+// a hit on a longer key also reads its record in the keyStore, one more cache miss. An unsuccessful
+// lookup usually never touches the slots at all. Growing moves the slots with their cached hashes and
+// keyRefs, without rehashing or copying any key.
+//
+// Groups are probed in the order g, g + 1, g + 3, g + 6, ... (triangular numbers), which visits
+// every group when the number of groups is a power of two.
+// Deleting from a group that still has an EMPTY slot can make the slot EMPTY again, since no
+// probe sequence could have passed through that group; otherwise a tombstone is left.
+// The table is rebuilt when full slots plus tombstones would exceed 7/8 of the capacity.
+// The keyStore is compacted by delete() once deleted keys fill half of it.
+// Keys are hashed with the seeded hashString() from hash-functions.h; its 64 bits are well mixed,
+// so h1 and h2 can simply be cut from the same value.
+
+#define GROUP_WIDTH 16
+#define INITIAL_GROUPS 1   // must be a power of two
+
+#define CTRL_EMPTY   ((int8_t)0x80)
+#define CTRL_DELETED ((int8_t)0xFE)
+
+typedef struct Slot{
+    keyRef key;
+    uint64_t hash;
+    int data;
+} slot;
+
+typedef struct HashTable{
+    int8_t* ctrl;          // capacity control bytes
+    slot* slots;           // capacity slots
+    size_t groupMask;      // number of groups - 1
+    size_t capacity;
+    size_t count;
+    size_t tombstones;
+    uint64_t seed;         // random per table
+    keyStore keys;         // the keys longer than KEY_INLINE_MAX
+} hashTable;
+
+// Bit i of the result is set when ctrl[i] of the group equals byte
+unsigned int matchByte(const int8_t* group, int8_t byte){
+#ifdef __SSE2__
+    __m128i ctrl = _mm_loadu_si128((const __m128i*)group);
+    return (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(byte)));
+#else
+    unsigned int mask = 0;
+    for(int i = 0; i < GROUP_WIDTH; ++i){
+        if(group[i] == byte){
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+#endif
+}
+
+// Bit i is set when slot i of the group is EMPTY or DELETED (the control byte has its top bit set)
+unsigned int matchEmptyOrDeleted(const int8_t* group){
+#ifdef __SSE2__
+    return (unsigned int)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)group));
+#else
+    unsigned int mask = 0;
+    for(int i = 0; i < GROUP_WIDTH; ++i){
+        if(group[i] < 0){
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+#endif
+}
+
+hashTable* newHashTableWithGroups(size_t groups, uint64_t seed){
+    hashTable* table = malloc(sizeof(hashTable));
+    table->capacity = groups * GROUP_WIDTH;
+    table->groupMask = groups - 1;
+    table->ctrl = malloc(table->capacity);
+    memset(table->ctrl, CTRL_EMPTY, table->capacity);
+    table->slots = malloc(sizeof(slot) * table->capacity);
+    table->count = 0;
+    table->tombstones = 0;
+    table->seed = seed;
+    keyStoreInit(&table->keys);
+
+    return table;
+}
+
+hashTable* newHashTable(){
+    return newHashTableWithGroups(INITIAL_GROUPS, hashSeed());
+}
+
+// Returns the index of key's slot, or -1
+long findSlot(hashTable* table, const char* key, size_t keyLen, uint64_t h){
+    size_t g = (h >> 7) & table->groupMask;
+    int8_t h2 = h & 0x7F;
+    for(size_t i = 1;; g = (g + i) & table->groupMask, ++i){
+        const int8_t* group = table->ctrl + g * GROUP_WIDTH;
+        for(unsigned int m = matchByte(group, h2); m != 0; m &= m - 1){
+            size_t s = g * GROUP_WIDTH + __builtin_ctz(m);
+            if(table->slots[s].hash == h && keyRefEquals(&table->keys, &table->slots[s].key, key, keyLen)){
+                return s;
+            }
+        }
+        if(matchByte(group, CTRL_EMPTY) != 0){
+            return -1;
+        }
+        if(i > table->groupMask){   // every group was visited
+            return -1;
+        }
+    }
+}
+
+// First EMPTY or DELETED slot on h's probe sequence
+size_t findFreeSlot(hashTable* table, uint64_t h){
+    size_t g = (h >> 7) & table->groupMask;
+    for(size_t i = 1;; g = (g + i) & table->groupMask, ++i){
+        unsigned int m = matchEmptyOrDeleted(table->ctrl + g * GROUP_WIDTH);
+        if(m != 0){
+            return g * GROUP_WIDTH + __builtin_ctz(m);
+        }
+    }
+}
+
+void resize(hashTable* table, size_t groups){
+    int8_t* oldCtrl = table->ctrl;
+    slot* oldSlots = table->slots;
+    size_t oldCapacity = table->capacity;
+
+    hashTable* fresh = newHashTableWithGroups(groups, table->seed);
+    for(size_t i = 0; i < oldCapacity; ++i){
+        if(oldCtrl[i] >= 0){
+            uint64_t h = oldSlots[i].hash;
+            size_t s = findFreeSlot(fresh, h);
+            fresh->ctrl[s] = h & 0x7F;
+            fresh->slots[s] = oldSlots[i];
+        }
+    }
+    table->ctrl = fresh->ctrl;
+    table->slots = fresh->slots;
+    table->capacity = fresh->capacity;
+    table->groupMask = fresh->groupMask;
+    table->tombstones = 0;
+    free(fresh);
+    free(oldCtrl);
+    free(oldSlots);
+}
+
+void insert(hashTable* table, const char* key, int value){
+    size_t keyLen = strlen(key);
+    uint64_t h = hashString(key, keyLen, table->seed);
+    long i = findSlot(table, key, keyLen, h);
+    if(i >= 0){
+        table->slots[i].data = value;
+        return;
+    }
+    if((table->count + table->tombstones + 1) * 8 > table->capacity * 7){
+        size_t groups = table->groupMask + 1;
+        // a table full of tombstones is only cleaned, not grown
+        resize(table, (table->count + 1) * 2 > table->capacity ? groups * 2 : groups);
+    }
+    size_t s = findFreeSlot(table, h);
+    if(table->ctrl[s] == CTRL_DELETED){
+        --(table->tombstones);
+    }
+    table->ctrl[s] = h & 0x7F;
+    table->slots[s].key = keyStoreAdd(&table->keys, key, keyLen);
+    table->slots[s].hash = h;
+    table->slots[s].data = value;
+    ++(table->count);
+}
+
+// Copies the keys of the full slots to a fresh store, leaving out the deleted ones
+void compactKeys(hashTable* table){
+    keyStore fresh;
+    keyStoreInit(&fresh);
+    for(size_t i = 0; i < table->capacity; ++i){
+        if(table->ctrl[i] >= 0){
+            keyStoreRelocate(&fresh, &table->keys, &table->slots[i].key);
+        }
+    }
+    keyStoreReplace(&table->keys, &fresh);
+}
+
+void delete(hashTable* table, const char* key){
+    size_t keyLen = strlen(key);
+    long i = findSlot(table, key, keyLen, hashString(key, keyLen, table->seed));
+    if(i < 0){
+        printf("No such element found\n");
+        return;
+    }
+    keyStoreRelease(&table->keys, &table->slots[i].key);
+    const int8_t* group = table->ctrl + (i / GROUP_WIDTH) * GROUP_WIDTH;
+    if(matchByte(group, CTRL_EMPTY) != 0){
+        table->ctrl[i] = CTRL_EMPTY;
+    }
+    else{
+        table->ctrl[i] = CTRL_DELETED;
+        ++(table->tombstones);
+    }
+    --(table->count);
+    if(keyStoreNeedsCompaction(&table->keys)){
+        compactKeys(table);
+    }
+}
+
+int pop(hashTable* table, const char* key){
+    size_t keyLen = strlen(key);
+    long i = findSlot(table, key, keyLen, hashString(key, keyLen, table->seed));
+    if(i < 0){
+        printf("No such element found. Exit status: ");
+        return EXIT_FAILURE;
+    }
+    return table->slots[i].data;
+}
+
+void dump(hashTable* table){
+    for(size_t i = 0; i < table->capacity; ++i){
+        if(table->ctrl[i] < 0){
+            continue;
+        }
+        slot* e = &table->slots[i];
+        printf("slot[%4zu]: %.*s = %d (h2 = 0x%02x)\n", i, (int)keyRefLen(&e->key), keyRefBytes(&table->keys, &e->key),
+               e->data, table->ctrl[i]);
+    }
+}
+
+void freeHashTable(hashTable* table){
+    keyStoreFree(&table->keys);
+    free(table->ctrl);
+    free(table->slots);
+    free(table);
+}
+
+
+int main(int argc, char* argv[]){
+
+    hashTable* myTable = newHashTable();
+
+    insert(myTable, "amir", 17);
+    insert(myTable, "azin", 24);
+    insert(myTable, "aZMZ", 42);
+    insert(myTable, "munisa", 26);
+    dump(myTable);
+
+    printf("\n%d\n", pop(myTable, "aZMZ"));
+    printf("%d", pop(myTable, "adsaa"));
+    printf("\n\n");
+
+    delete(myTable, "azin");
+    dump(myTable);
+
+    printf("\n");
+    insert(myTable, "azin", 24);
+    dump(myTable);
+
+    freeHashTable(myTable);
+}
@@ -1,36 +1,42 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "hash-functions.h"
+#include "key-store.h"
+#include "hash-table-stats.h"
+#include "membership-filters.h"
 
 // Simple implementation of hash table with chaining using doubly linked list and array of constant size
 // No operation (function) provided supports error-checking
+// Keys are kept in keyRefs: short keys inside the node, long ones in the table's keyStore (see key-store.h),
+// which deleteKey() compacts once deleted keys fill half of it
+// With -DHASH_TABLE_STATS the nodes examined by every operation are counted, and statsReport()
+// gives the chain lengths, load factor and memory per key (see hash-table-stats.h)
+// setMembershipFilter() puts a counting Bloom filter in front of the table (see membership-filters.h):
+// a lookup or delete of a missing key then usually reads one cache line instead of walking a chain
 
 // Implementation of hash table with string value instead and singly linked list: https://github.com/engineer-man/youtube/blob/master/077/hashtable.c
 
 #define CAPACITY 701
 
 typedef struct Node{
-    char *key;
-    int data;        
+    keyRef key;
+    int data;
     struct Node *next;  
     struct Node *prev;  
 } node;
 
 typedef struct HashTable{
     node** entries;
+    uint64_t seed;    // random per table, see hash-functions.h
+    keyStore keys;
+    membershipGuard* guard;    // NULL when there is no filter
+    STATS_FIELD
 } hashTable;
 
 
-unsigned int hash(const char *key) {
-    unsigned long int value = 0;
-    unsigned int i = 0;
-    unsigned int key_len = strlen(key);
-    for(; i < key_len; ++i){
-        value = value * 37 + key[i];
-    }
-    value = value % CAPACITY;
-
-    return value;
+uint64_t hash(hashTable* table, const char *key, size_t keyLen) {
+    return hashString(key, keyLen, table->seed);
 }
 
 hashTable* newHashTable(){
@@ -39,15 +45,18 @@ hashTable* newHashTable(){
     for(int i = 0; i < CAPACITY; i++){
         table->entries[i] = NULL;
     }
+    table->seed = hashSeed();
+    keyStoreInit(&table->keys);
+    table->guard = NULL;
+    STATS_INIT(table);
 
     return table; 
 }
 
-void insertNodeAtEnd(node **head, const char* key, int value){
+void insertNodeAtEnd(hashTable* table, node **head, const char* key, size_t keyLen, int value){
     node *new_node = malloc(sizeof(node));
     node *last = *head;
-    new_node->key = malloc(strlen(key) + 1);
-    strcpy(new_node->key, key);
+    new_node->key = keyStoreAdd(&table->keys, key, keyLen);
     new_node->data = value;
     new_node->next = NULL;
     if(*head == NULL){
@@ -62,25 +71,31 @@ void insertNodeAtEnd(node **head, const char* key, int value){
     last->next = new_node;
 }
 
-node* search(node* tryNode, const char* key){
-    if(tryNode == NULL){
-        return NULL;
-    }
-
+node* search(hashTable* table, node* tryNode, const char* key, size_t keyLen){
+    size_t visited = 0;
     for(node* temp = tryNode; temp != NULL; temp = temp->next){
-        if(strcmp(temp->key, key) == 0){
+        ++visited;
+        if(keyRefEquals(&table->keys, &temp->key, key, keyLen)){
+            STATS_PROBE(table, visited);
             return temp;
         }
     }
+    STATS_PROBE(table, visited);
+    return NULL;
 }
 
 void insert(hashTable* table, const char* key, int value){
-    unsigned int slot = hash(key);
+    size_t keyLen = strlen(key);
+    uint64_t h = hash(table, key, keyLen);
+    unsigned int slot = h % CAPACITY;
     
-    node* entry = search(table->entries[slot], key);
+    node* entry = search(table, table->entries[slot], key, keyLen);
 
     if(entry == NULL){
-        insertNodeAtEnd(&table->entries[slot], key, value);
+        insertNodeAtEnd(table, &table->entries[slot], key, keyLen, value);
+        if(table->guard != NULL){
+            guardAdd(table->guard, h);
+        }
     }
     else{
         entry->data = value;
@@ -88,8 +103,12 @@ void insert(hashTable* table, const char* key, int value){
 }
 
 int popKey(hashTable* table, const char* key){
-    unsigned int slot = hash(key);
-    node* entry = search(table->entries[slot], key);
+    size_t keyLen = strlen(key);
+    uint64_t h = hash(table, key, keyLen);
+    if(table->guard != NULL && !guardMayContain(table->guard, h)){
+        return 0;
+    }
+    node* entry = search(table, table->entries[h % CAPACITY], key, keyLen);
     if(entry == NULL){
         return 0;
     }
@@ -98,16 +117,34 @@ int popKey(hashTable* table, const char* key){
     }
 }
 
+// Copies the keys of all nodes to a fresh store, leaving out the deleted ones
+void compactKeys(hashTable* table){
+    keyStore fresh;
+    keyStoreInit(&fresh);
+    for(int i = 0; i < CAPACITY; i++){
+        for(node* entry = table->entries[i]; entry != NULL; entry = entry->next){
+            keyStoreRelocate(&fresh, &table->keys, &entry->key);
+        }
+    }
+    keyStoreReplace(&table->keys, &fresh);
+}
+
 void deleteKey(hashTable* table, const char* key){
-    unsigned int slot = hash(key);
+    size_t keyLen = strlen(key);
+    uint64_t h = hash(table, key, keyLen);
+    if(table->guard != NULL && !guardMayContain(table->guard, h)){
+        return;
+    }
+    unsigned int slot = h % CAPACITY;
     node* entry = table->entries[slot];
     if(entry == NULL) {
+        STATS_PROBE(table, 0);
         return;
     }
     int idx = 0;
 
     while(entry != NULL) {
-        if(strcmp(entry->key, key) == 0) {
+        if(keyRefEquals(&table->keys, &entry->key, key, keyLen)) {
             // first item and no next entry
             if(entry->next == NULL && idx == 0) {
                 table->entries[slot] = NULL;
@@ -130,8 +167,15 @@ void deleteKey(hashTable* table, const char* key){
                 entry->prev = entry->next = NULL;
             }
 
-            free(entry->key);
+            keyStoreRelease(&table->keys, &entry->key);
             free(entry);
+            if(keyStoreNeedsCompaction(&table->keys)){
+                compactKeys(table);
+            }
+            if(table->guard != NULL){
+                guardRemove(table->guard, h);
+            }
+            STATS_PROBE(table, idx + 1);
 
             return;
         }
@@ -139,8 +183,96 @@ void deleteKey(hashTable* table, const char* key){
         entry = entry->next;
         ++idx;
     }
+    STATS_PROBE(table, idx);
+}
+
+// Puts a filter sized for expectedKeys in front of the table; the keys already there are added to it
+void setMembershipFilter(hashTable* table, size_t expectedKeys){
+    if(table->guard != NULL){
+        freeMembershipGuard(table->guard);
+    }
+    table->guard = newMembershipGuard(expectedKeys);
+    for(int i = 0; i < CAPACITY; i++){
+        for(node* entry = table->entries[i]; entry != NULL; entry = entry->next){
+            guardAdd(table->guard, hash(table, keyRefBytes(&table->keys, &entry->key), keyRefLen(&entry->key)));
+        }
+    }
 }
 
+// Builds the other two filters of membership-filters.h over the keys of the table and measures the
+// false positive rate of all three on "misses" keys that are not in it
+void compareFilters(hashTable* table, int misses){
+    size_t n = 0;
+    for(int i = 0; i < CAPACITY; i++){
+        for(node* entry = table->entries[i]; entry != NULL; entry = entry->next){
+            ++n;
+        }
+    }
+    uint64_t* hashes = malloc(sizeof(uint64_t) * n);
+    blockedBloom* bloom = newBlockedBloom(n, 10);
+    n = 0;
+    for(int i = 0; i < CAPACITY; i++){
+        for(node* entry = table->entries[i]; entry != NULL; entry = entry->next){
+            hashes[n] = hash(table, keyRefBytes(&table->keys, &entry->key), keyRefLen(&entry->key));
+            blockedBloomAdd(bloom, hashes[n++]);
+        }
+    }
+    xorFilter* xor = newXorFilter(hashes, n);
+    if(xor == NULL){
+        printf("xor filter: build failed\n");
+        freeBlockedBloom(bloom);
+        free(hashes);
+        return;
+    }
+
+    int bloomHits = 0, xorHits = 0, countingHits = 0;
+    char key[32];
+    for(int i = 0; i < misses; i++){
+        snprintf(key, sizeof key, "missing%d", i);
+        uint64_t h = hash(table, key, strlen(key));
+        bloomHits += blockedBloomContains(bloom, h);
+        xorHits += xorFilterContains(xor, h);
+        if(table->guard != NULL){
+            countingHits += countingBloomContains(table->guard->filter, h);
+        }
+    }
+    printf("%zu keys, false positives of %d misses:\n", n, misses);
+    printf("  blocked Bloom: %.2f%%, %.1f bits per key\n", 100.0 * bloomHits / misses,
+           bloom->blockCount * 256.0 / n);
+    printf("  xor:           %.2f%%, %.1f bits per key\n", 100.0 * xorHits / misses,
+           xor->segmentLength * 3 * 8.0 / n);
+    if(table->guard != NULL){
+        printf("  counting:      %.2f%%, %.1f bits per key\n", 100.0 * countingHits / misses,
+               table->guard->filter->blockCount * COUNTING_BLOCK * 8.0 / n);
+    }
+    freeXorFilter(xor);
+    freeBlockedBloom(bloom);
+    free(hashes);
+}
+
+#ifdef HASH_TABLE_STATS
+hashTableReport statsReport(hashTable* table){
+    hashTableReport report;
+    memset(&report, 0, sizeof(report));
+    report.counters = table->stats;
+    report.capacity = CAPACITY;
+    report.hasChains = 1;
+    for(int i = 0; i < CAPACITY; i++){
+        size_t length = 0;
+        for(node* entry = table->entries[i]; entry != NULL; entry = entry->next){
+            ++length;
+        }
+        statsRecord(report.chainLengths, length);
+        report.count += length;
+    }
+    report.loadFactor = (double)report.count / CAPACITY;
+    size_t bytes = sizeof(hashTable) + sizeof(node*) * CAPACITY
+                   + report.count * (sizeof(node) + STATS_MALLOC_OVERHEAD) + table->keys.size;
+    report.bytesPerEntry = report.count ? (double)bytes / report.count : 0.0;
+    return report;
+}
+#endif
+
 void dumpHashTable(hashTable* table) {
     for (int i = 0; i < CAPACITY; ++i) {
         node* entry = table->entries[i];
@@ -152,7 +284,7 @@ void dumpHashTable(hashTable* table) {
         printf("slot[%4d]: ", i);
 
         for(;;) {
-            printf("%s = %d ", entry->key, entry->data);
+            printf("%.*s = %d ", (int)keyRefLen(&entry->key), keyRefBytes(&table->keys, &entry->key), entry->data);
 
             if (entry->next == NULL) {
                 break;
@@ -165,6 +297,23 @@ void dumpHashTable(hashTable* table) {
     }
 }
 
+void freeHashTable(hashTable* table){
+    for(int i = 0; i < CAPACITY; i++){
+        node* entry = table->entries[i];
+        while(entry != NULL){
+            node* next = entry->next;
+            free(entry);
+            entry = next;
+        }
+    }
+    if(table->guard != NULL){
+        freeMembershipGuard(table->guard);
+    }
+    keyStoreFree(&table->keys);
+    free(table->entries);
+    free(table);
+}
+
 
 int main(int argc, char* argv[]){
     hashTable* myTable = newHashTable();
@@ -190,6 +339,43 @@ int main(int argc, char* argv[]){
 
     dumpHashTable(myTable);
 
-    printf("%d", popKey(myTable, "name1"));
+    printf("%d\n", popKey(myTable, "name1"));
+
+    // mostly misses: the filter answers nearly all of them without touching the chains
+    setMembershipFilter(myTable, 2000);
+    char name[16];
+    for(int i = 0; i < 1000; i++){
+        sprintf(name, "id%d", i);
+        insert(myTable, name, i);
+    }
+    int hits = 0;
+    for(int i = 0; i < 10000; i++){
+        sprintf(name, "id%d", i);
+        hits += popKey(myTable, name) != 0 || i == 0;
+    }
+    printf("%d hits, %lu of %lu lookups answered by the filter\n", hits, myTable->guard->skipped,
+           myTable->guard->lookups);
+
+    // the three filters over 100000 keys, each sized for them
+    hashTable* big = newHashTable();
+    for(int i = 0; i < 100000; i++){
+        snprintf(name, sizeof name, "id%d", i);
+        insert(big, name, i);
+    }
+    setMembershipFilter(big, 100000);
+    compareFilters(big, 1000000);
+
+#ifdef HASH_TABLE_STATS
+    char key[16];
+    for(int i = 0; i < 1000; i++){
+        sprintf(key, "key%d", i);
+        insert(myTable, key, i);
+    }
+    hashTableReport report = statsReport(myTable);
+    printf("\n");
+    statsPrintJson(stdout, &report);
+#endif
 
+    freeHashTable(big);
+    freeHashTable(myTable);
 }
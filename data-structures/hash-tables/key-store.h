@@ -0,0 +1,139 @@
+#ifndef KEY_STORE_H
+#define KEY_STORE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Compact storage for the string keys of a hash table.
+//
+// Copying every key with malloc(keyLen + 1) costs a malloc header (usually 16 bytes) and a
+// rounded-up block per key, plus an 8-byte pointer and an 8-byte length in the entry, and every
+// key comparison jumps to some random place in the heap. Here a key is held by a 16-byte keyRef:
+//  keys of up to KEY_INLINE_MAX = 15 bytes are stored inline, in the keyRef itself
+//  (bytes[0..14], with the length in bytes[15]), so comparing them touches no other memory;
+//  longer keys are appended to the table's keyStore, one big contiguous array, as a 4-byte length
+//  followed by the key bytes, and the keyRef holds the 32-bit offset of that record, the length,
+//  and the first 4 bytes of the key, so most unequal keys are told apart without reading the store.
+// Offsets count KEY_ALIGN-byte units, so a store holds up to 16GB of keys. Because they are offsets
+// and not pointers, the array can be moved by realloc() while it grows.
+// The bytes of a deleted key cannot be reused in place, since the store is one array of records of
+// all sizes, so keyStoreRelease() only counts them. When deleted keys take more than half of the
+// store (keyStoreNeedsCompaction()), the table copies its live keys to a fresh store with
+// keyStoreRelocate(), which also updates their keyRefs, and keyStoreReplace() frees the old one.
+// Between two compactions at least as many bytes are deleted as are copied by the second one,
+// so compaction is amortized O(1) per deleted byte and the store stays under about twice its live keys.
+
+#define KEY_INLINE_MAX 15
+#define KEY_IN_STORE 0xFF          // bytes[15] of a keyRef whose key is in the store
+#define KEY_ALIGN 4
+#define KEY_STORE_INITIAL_SIZE (64 * 1024)
+
+typedef struct KeyRef{
+    union{
+        unsigned char bytes[KEY_INLINE_MAX + 1];
+        struct{
+            uint32_t offset;       // in KEY_ALIGN units
+            uint32_t len;
+            char prefix[4];
+        } stored;
+    };
+} keyRef;
+
+typedef struct KeyStore{
+    char* bytes;
+    size_t used, size;
+    size_t released;               // bytes of keys that were deleted
+} keyStore;
+
+static inline void keyStoreInit(keyStore* store){
+    store->bytes = NULL;
+    store->used = store->size = 0;
+    store->released = 0;
+}
+
+static inline void keyStoreFree(keyStore* store){
+    free(store->bytes);
+    keyStoreInit(store);
+}
+
+static inline size_t keyStoreRecordSize(size_t keyLen){
+    return (sizeof(uint32_t) + keyLen + KEY_ALIGN - 1) / KEY_ALIGN * KEY_ALIGN;
+}
+
+static inline keyRef keyStoreAdd(keyStore* store, const char* key, size_t keyLen){
+    keyRef ref;
+    memset(&ref, 0, sizeof(ref));
+    if(keyLen <= KEY_INLINE_MAX){
+        memcpy(ref.bytes, key, keyLen);
+        ref.bytes[KEY_INLINE_MAX] = (unsigned char)keyLen;
+        return ref;
+    }
+    size_t record = keyStoreRecordSize(keyLen);
+    if(store->size - store->used < record){
+        size_t size = store->size ? store->size : KEY_STORE_INITIAL_SIZE;
+        while(size - store->used < record){
+            size *= 2;
+        }
+        store->bytes = realloc(store->bytes, size);
+        store->size = size;
+    }
+    uint32_t len = (uint32_t)keyLen;
+    memcpy(store->bytes + store->used, &len, sizeof(len));
+    memcpy(store->bytes + store->used + sizeof(len), key, keyLen);
+    ref.stored.offset = (uint32_t)(store->used / KEY_ALIGN);
+    ref.stored.len = len;
+    memcpy(ref.stored.prefix, key, 4);
+    ref.bytes[KEY_INLINE_MAX] = KEY_IN_STORE;
+    store->used += record;
+    return ref;
+}
+
+static inline void keyStoreRelease(keyStore* store, const keyRef* ref){
+    if(ref->bytes[KEY_INLINE_MAX] == KEY_IN_STORE){
+        store->released += keyStoreRecordSize(ref->stored.len);
+    }
+}
+
+// Whether more than half of the store belongs to deleted keys (small stores are left alone)
+static inline int keyStoreNeedsCompaction(const keyStore* store){
+    return store->released > KEY_STORE_INITIAL_SIZE && store->released > store->used / 2;
+}
+
+static inline size_t keyRefLen(const keyRef* ref){
+    unsigned char tag = ref->bytes[KEY_INLINE_MAX];
+    return tag == KEY_IN_STORE ? ref->stored.len : tag;
+}
+
+// The key bytes (not terminated by '\0'), valid until the next keyStoreAdd()
+static inline const char* keyRefBytes(const keyStore* store, const keyRef* ref){
+    if(ref->bytes[KEY_INLINE_MAX] == KEY_IN_STORE){
+        return store->bytes + (size_t)ref->stored.offset * KEY_ALIGN + sizeof(uint32_t);
+    }
+    return (const char*)ref->bytes;
+}
+
+static inline int keyRefEquals(const keyStore* store, const keyRef* ref, const char* key, size_t keyLen){
+    if(keyLen <= KEY_INLINE_MAX){
+        return ref->bytes[KEY_INLINE_MAX] == keyLen && memcmp(ref->bytes, key, keyLen) == 0;
+    }
+    return ref->bytes[KEY_INLINE_MAX] == KEY_IN_STORE && ref->stored.len == keyLen
+           && memcmp(ref->stored.prefix, key, 4) == 0
+           && memcmp(keyRefBytes(store, ref) + 4, key + 4, keyLen - 4) == 0;
+}
+
+// Copies the key of ref from "from" to "to" and points ref at the copy (inline keys stay as they are)
+static inline void keyStoreRelocate(keyStore* to, const keyStore* from, keyRef* ref){
+    if(ref->bytes[KEY_INLINE_MAX] == KEY_IN_STORE){
+        *ref = keyStoreAdd(to, keyRefBytes(from, ref), ref->stored.len);
+    }
+}
+
+// Frees store and makes it the fresh one that the live keys were relocated to
+static inline void keyStoreReplace(keyStore* store, keyStore* fresh){
+    keyStoreFree(store);
+    *store = *fresh;
+    keyStoreInit(fresh);
+}
+
+#endif
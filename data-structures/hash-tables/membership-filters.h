@@ -0,0 +1,300 @@
+#ifndef MEMBERSHIP_FILTERS_H
+#define MEMBERSHIP_FILTERS_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hash-functions.h"
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// Approximate membership filters: small structures that answer "is key in the set?" with
+// "certainly not" or "probably yes". A filter in front of a hash table makes most misses cheap:
+// a lookup of a key that is not there usually costs one cache line of the filter instead of a walk
+// along a chain or a probe sequence. All filters take the 64-bit hash of a key (hashString() with
+// any seed); the same hash must be used for adding and testing.
+//
+// blockedBloom - a split block Bloom filter (as in Impala and Parquet). The bits are grouped into
+//  blocks of 256 bits (8 32-bit words, half a cache line); a key chooses one block and sets one bit
+//  in each of its 8 words. A test reads one block only, and with AVX2 the 8 bit positions are
+//  computed and tested in one vector. About 1.3% false positives with 10 bits per key. No deletes.
+// xorFilter - for a set that never changes (Graf and Lemire, "Xor Filters", 2019). Every key has
+//  three slots, one in each third of an array of 8-bit fingerprints, chosen so that the xor of
+//  the three is the key's fingerprint. Built by "peeling": a slot that only one key uses can be set
+//  last for that key. 9.84 bits per key and about 0.4% false positives; a test reads 3 bytes.
+// countingBloom - a Bloom filter with counters instead of bits, so keys can be removed.
+//  A key uses COUNTING_HASHES 8-bit counters inside one 64-byte block (one cache line).
+//  A counter that reaches 255 stays there, since it no longer knows how many keys it counts.
+//
+// membershipGuard puts a countingBloom in front of any table: call guardAdd() when a new key is
+// inserted, guardRemove() when a key is deleted, and skip the lookup when guardMayContain() is 0.
+// compareFilters() in hash-table_with_chaining.c builds all three over the keys of a table and
+// measures their false positive rates and sizes (the figures above are for 100000 keys).
+
+#define BLOOM_BLOCK_WORDS 8
+#define XOR_MAX_ATTEMPTS 64
+#define COUNTING_BLOCK 64             // counters per block
+#define COUNTING_HASHES 4
+#define COUNTING_KEYS_PER_BLOCK 6     // about 1.6% false positives, 10.7 bytes per key
+
+// floor(x * n / 2^64)
+static inline uint64_t filterRange(uint64_t x, uint64_t n){
+    return (uint64_t)(((__uint128_t)x * n) >> 64);
+}
+
+
+// Split block Bloom filter
+
+typedef struct BlockedBloom{
+    uint32_t (*blocks)[BLOOM_BLOCK_WORDS];
+    size_t blockCount;
+} blockedBloom;
+
+static const uint32_t bloomSalt[BLOOM_BLOCK_WORDS] = {
+    0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+    0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U};
+
+static inline blockedBloom* newBlockedBloom(size_t expectedKeys, unsigned int bitsPerKey){
+    blockedBloom* filter = malloc(sizeof(blockedBloom));
+    filter->blockCount = (expectedKeys * bitsPerKey + 255) / 256 + 1;
+    filter->blocks = aligned_alloc(64, (filter->blockCount * 32 + 63) / 64 * 64);
+    memset(filter->blocks, 0, filter->blockCount * 32);
+    return filter;
+}
+
+static inline void freeBlockedBloom(blockedBloom* filter){
+    free(filter->blocks);
+    free(filter);
+}
+
+static inline void blockedBloomAdd(blockedBloom* filter, uint64_t h){
+    uint32_t* block = filter->blocks[filterRange(h, filter->blockCount)];
+    for(int i = 0; i < BLOOM_BLOCK_WORDS; i++){
+        block[i] |= 1u << (((uint32_t)h * bloomSalt[i]) >> 27);
+    }
+}
+
+static inline int blockedBloomContains(const blockedBloom* filter, uint64_t h){
+    const uint32_t* block = filter->blocks[filterRange(h, filter->blockCount)];
+#ifdef __AVX2__
+    __m256i salt = _mm256_loadu_si256((const __m256i*)bloomSalt);
+    __m256i shifts = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_set1_epi32((uint32_t)h), salt), 27);
+    __m256i mask = _mm256_sllv_epi32(_mm256_set1_epi32(1), shifts);
+    // every bit of mask must be set in the block: testc checks (~block & mask) == 0
+    return _mm256_testc_si256(_mm256_load_si256((const __m256i*)block), mask);
+#else
+    for(int i = 0; i < BLOOM_BLOCK_WORDS; i++){
+        if((block[i] & (1u << (((uint32_t)h * bloomSalt[i]) >> 27))) == 0){
+            return 0;
+        }
+    }
+    return 1;
+#endif
+}
+
+
+// Xor filter
+
+typedef struct XorFilter{
+    uint64_t seed;
+    size_t segmentLength;         // the array has 3 segments
+    uint8_t* fingerprints;
+} xorFilter;
+
+static inline uint8_t xorFingerprint(uint64_t h){
+    return (uint8_t)(h ^ (h >> 32));
+}
+
+static inline size_t xorSlot(const xorFilter* filter, uint64_t h, int i){
+    uint64_t r = i == 0 ? h : (h << (21 * i)) | (h >> (64 - 21 * i));   // another part of h for every segment
+    return i * filter->segmentLength + (((r & 0xFFFFFFFFULL) * filter->segmentLength) >> 32);
+}
+
+static inline void freeXorFilter(xorFilter* filter){
+    free(filter->fingerprints);
+    free(filter);
+}
+
+// Builds the filter for n distinct hashes; NULL if the peeling keeps failing (repeated hashes)
+static inline xorFilter* newXorFilter(const uint64_t* hashes, size_t n){
+    xorFilter* filter = malloc(sizeof(xorFilter));
+    filter->segmentLength = (size_t)(1.23 * n + 32) / 3 + 1;
+    size_t capacity = 3 * filter->segmentLength;
+    filter->fingerprints = malloc(capacity);
+    uint32_t* counts = malloc(sizeof(uint32_t) * capacity);
+    uint64_t* xors = malloc(sizeof(uint64_t) * capacity);    // xor of the hashes of the keys in a slot
+    size_t* queue = malloc(sizeof(size_t) * capacity);
+    uint64_t* stackHash = malloc(sizeof(uint64_t) * (n + 1));
+    size_t* stackSlot = malloc(sizeof(size_t) * (n + 1));
+    uint64_t seed = hashSeed();
+    int built = 0;
+
+    for(int attempt = 0; attempt < XOR_MAX_ATTEMPTS && !built; attempt++){
+        filter->seed = seed = fmix64(seed + attempt);
+        memset(counts, 0, sizeof(uint32_t) * capacity);
+        memset(xors, 0, sizeof(uint64_t) * capacity);
+        for(size_t k = 0; k < n; k++){
+            uint64_t h = fmix64(hashes[k] ^ seed);
+            for(int i = 0; i < 3; i++){
+                size_t s = xorSlot(filter, h, i);
+                ++counts[s];
+                xors[s] ^= h;
+            }
+        }
+        // peel: a slot with one key left decides that key, which is then taken out of its other slots
+        size_t queued = 0, stacked = 0;
+        for(size_t s = 0; s < capacity; s++){
+            if(counts[s] == 1){
+                queue[queued++] = s;
+            }
+        }
+        while(queued > 0){
+            size_t s = queue[--queued];
+            if(counts[s] != 1){
+                continue;
+            }
+            uint64_t h = xors[s];
+            stackHash[stacked] = h;
+            stackSlot[stacked++] = s;
+            for(int i = 0; i < 3; i++){
+                size_t t = xorSlot(filter, h, i);
+                --counts[t];
+                xors[t] ^= h;
+                if(counts[t] == 1){
+                    queue[queued++] = t;
+                }
+            }
+        }
+        built = stacked == n;
+    }
+    if(built){
+        // in reverse peeling order every key's own slot is still free to choose
+        memset(filter->fingerprints, 0, capacity);
+        while(n-- > 0){
+            uint64_t h = stackHash[n];
+            uint8_t f = xorFingerprint(h);
+            for(int i = 0; i < 3; i++){
+                size_t t = xorSlot(filter, h, i);
+                if(t != stackSlot[n]){
+                    f ^= filter->fingerprints[t];
+                }
+            }
+            filter->fingerprints[stackSlot[n]] = f;
+        }
+    }
+    free(counts);
+    free(xors);
+    free(queue);
+    free(stackHash);
+    free(stackSlot);
+    if(!built){
+        freeXorFilter(filter);
+        return NULL;
+    }
+    return filter;
+}
+
+static inline int xorFilterContains(const xorFilter* filter, uint64_t h){
+    h = fmix64(h ^ filter->seed);
+    return xorFingerprint(h) == (filter->fingerprints[xorSlot(filter, h, 0)]
+                                 ^ filter->fingerprints[xorSlot(filter, h, 1)]
+                                 ^ filter->fingerprints[xorSlot(filter, h, 2)]);
+}
+
+
+// Counting Bloom filter, one cache line per key
+
+typedef struct CountingBloom{
+    uint8_t (*blocks)[COUNTING_BLOCK];
+    size_t blockCount;
+} countingBloom;
+
+static inline countingBloom* newCountingBloom(size_t expectedKeys){
+    countingBloom* filter = malloc(sizeof(countingBloom));
+    filter->blockCount = expectedKeys / COUNTING_KEYS_PER_BLOCK + 1;
+    filter->blocks = aligned_alloc(64, filter->blockCount * COUNTING_BLOCK);
+    memset(filter->blocks, 0, filter->blockCount * COUNTING_BLOCK);
+    return filter;
+}
+
+static inline void freeCountingBloom(countingBloom* filter){
+    free(filter->blocks);
+    free(filter);
+}
+
+// The i-th counter of h inside its block, from 6 bits of the low half of h each
+static inline unsigned int countingSlot(uint64_t h, int i){
+    return ((uint32_t)h >> (6 * i)) % COUNTING_BLOCK;
+}
+
+static inline void countingBloomAdd(countingBloom* filter, uint64_t h){
+    uint8_t* block = filter->blocks[filterRange(h, filter->blockCount)];
+    for(int i = 0; i < COUNTING_HASHES; i++){
+        uint8_t* c = &block[countingSlot(h, i)];
+        if(*c != UINT8_MAX){
+            ++*c;
+        }
+    }
+}
+
+// h must have been added
+static inline void countingBloomRemove(countingBloom* filter, uint64_t h){
+    uint8_t* block = filter->blocks[filterRange(h, filter->blockCount)];
+    for(int i = 0; i < COUNTING_HASHES; i++){
+        uint8_t* c = &block[countingSlot(h, i)];
+        if(*c != UINT8_MAX && *c != 0){
+            --*c;
+        }
+    }
+}
+
+static inline int countingBloomContains(const countingBloom* filter, uint64_t h){
+    const uint8_t* block = filter->blocks[filterRange(h, filter->blockCount)];
+    for(int i = 0; i < COUNTING_HASHES; i++){
+        if(block[countingSlot(h, i)] == 0){
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+// A filter in front of a table
+
+typedef struct MembershipGuard{
+    countingBloom* filter;
+    unsigned long lookups;
+    unsigned long skipped;        // lookups answered by the filter alone
+} membershipGuard;
+
+static inline membershipGuard* newMembershipGuard(size_t expectedKeys){
+    membershipGuard* guard = malloc(sizeof(membershipGuard));
+    guard->filter = newCountingBloom(expectedKeys);
+    guard->lookups = guard->skipped = 0;
+    return guard;
+}
+
+static inline void freeMembershipGuard(membershipGuard* guard){
+    freeCountingBloom(guard->filter);
+    free(guard);
+}
+
+static inline void guardAdd(membershipGuard* guard, uint64_t h){
+    countingBloomAdd(guard->filter, h);
+}
+
+static inline void guardRemove(membershipGuard* guard, uint64_t h){
+    countingBloomRemove(guard->filter, h);
+}
+
+static inline int guardMayContain(membershipGuard* guard, uint64_t h){
+    ++(guard->lookups);
+    if(!countingBloomContains(guard->filter, h)){
+        ++(guard->skipped);
+        return 0;
+    }
+    return 1;
+}
+
+#endif
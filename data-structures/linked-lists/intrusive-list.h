@@ -0,0 +1,114 @@
+#ifndef INTRUSIVE_LIST_H
+#define INTRUSIVE_LIST_H
+
+#include <stddef.h>
+
+// Intrusive doubly linked list: the links live inside the user's own struct, instead of a node
+// that owns an int (as in doubly_linked_list.c). A struct that embeds a listLink can be put on a list
+// without allocating anything, it can be on several lists at once (one listLink member per list),
+// and, given a pointer to the struct, it is removed in O(1) without searching for it.
+// containerOf(link, type, member) gets back from a listLink to the struct that contains it.
+//
+// A list is a circular one with a sentinel: the head is a listLink that is not in any struct, and
+// head->next is the first element, head->prev the last one, head itself stands for "no element".
+// Thanks to the sentinel, insert and remove have no special cases for an empty list or for the ends.
+// All operations are O(1), splice too: it moves all the elements of one list to another at once.
+
+typedef struct ListLink{
+    struct ListLink *next;
+    struct ListLink *prev;
+} listLink;
+
+#define containerOf(ptr, type, member) ((type*)((char*)(ptr) - offsetof(type, member)))
+
+// for(listLink *it = head->next; it != head; it = it->next); it must not be removed inside the loop
+#define listForEach(it, head) for(listLink *it = (head)->next; it != (head); it = it->next)
+
+static inline void listInit(listLink *head){
+    head->next = head->prev = head;
+}
+
+static inline int listEmpty(const listLink *head){
+    return head->next == head;
+}
+
+// Puts link between prev and next, which must be adjacent
+static inline void listInsertBetween(listLink *link, listLink *prev, listLink *next){
+    link->prev = prev;
+    link->next = next;
+    prev->next = link;
+    next->prev = link;
+}
+
+static inline void listPushFront(listLink *head, listLink *link){
+    listInsertBetween(link, head, head->next);
+}
+
+static inline void listPushBack(listLink *head, listLink *link){
+    listInsertBetween(link, head->prev, head);
+}
+
+static inline void listInsertAfter(listLink *pos, listLink *link){
+    listInsertBetween(link, pos, pos->next);
+}
+
+// Takes link off whatever list it is on
+static inline void listRemove(listLink *link){
+    link->prev->next = link->next;
+    link->next->prev = link->prev;
+    link->next = link->prev = link;
+}
+
+static inline void listMoveToFront(listLink *head, listLink *link){
+    if(head->next != link){
+        listRemove(link);
+        listPushFront(head, link);
+    }
+}
+
+// The first / last element, removed from the list; NULL if the list is empty
+static inline listLink* listPopFront(listLink *head){
+    if(listEmpty(head)){
+        return NULL;
+    }
+    listLink *link = head->next;
+    listRemove(link);
+    return link;
+}
+
+static inline listLink* listPopBack(listLink *head){
+    if(listEmpty(head)){
+        return NULL;
+    }
+    listLink *link = head->prev;
+    listRemove(link);
+    return link;
+}
+
+// Moves all the elements of other, in order, to the front of head; other becomes empty
+static inline void listSplice(listLink *head, listLink *other){
+    if(listEmpty(other)){
+        return;
+    }
+    listLink *first = other->next, *last = other->prev;
+    last->next = head->next;
+    head->next->prev = last;
+    head->next = first;
+    first->prev = head;
+    listInit(other);
+}
+
+// Moves all the elements of other, in order, to the back of head; other becomes empty
+static inline void listSpliceBack(listLink *head, listLink *other){
+    if(listEmpty(other)){
+        return;
+    }
+    listLink *first = other->next, *last = other->prev;
+    first->prev = head->prev;
+    head->prev->next = first;
+    head->prev = last;
+    last->next = head;
+    listInit(other);
+}
+
+#endif
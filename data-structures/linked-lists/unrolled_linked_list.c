@@ -0,0 +1,318 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// An unrolled linked list is a linked list in which every node holds a small array of keys
+// instead of one key. Here a node is exactly one cache line: the next pointer, the number of keys
+// in use and UNROLLED_CAPACITY keys (13 ints with 64-byte lines and 8-byte pointers).
+//
+// One node per int, as in singly_linked_list.c, costs 16 bytes of node and about 16 bytes of malloc
+// bookkeeping for 4 bytes of key, and walking the list is one cache miss per key, since the nodes lie
+// wherever malloc put them. With 13 keys per node the list takes under 5 bytes per key once the
+// nodes are full, and a walk reads the keys of a node as an array: one miss per 13 keys.
+//
+// The list also keeps a pointer to its last node and its size, so appending (the common case for
+// logs and event lists) is O(1) and llSize() is not a walk any more. Appending fills the last node and
+// starts a new one when it is full, so appended nodes are always full.
+// Inserting or deleting in the middle works on one node: an insert into a full node first splits it
+// into two half-full ones, a delete that leaves a node less than half full moves keys from the next
+// node, or merges with it when both fit in one. So every node except the last is at least half full,
+// and finding position i takes about i / (UNROLLED_CAPACITY / 2) steps instead of i.
+//
+// Iterating block by block (ulNextBlock()) hands out each node's keys as a plain array.
+
+#define CACHE_LINE 64
+#define UNROLLED_CAPACITY ((CACHE_LINE - sizeof(void*) - sizeof(int)) / sizeof(int))
+
+typedef struct UnrolledNode{
+    struct UnrolledNode *next;
+    int count;                        // keys in use, keys[0..count-1]
+    int keys[UNROLLED_CAPACITY];
+} unrolledNode;
+
+typedef struct UnrolledList{
+    unrolledNode *head;
+    unrolledNode *tail;
+    size_t size;                      // keys
+    size_t nodes;
+} unrolledList;
+
+typedef struct UnrolledIterator{
+    unrolledNode *node;
+} unrolledIterator;
+
+
+void initUnrolledList(unrolledList *);
+void freeUnrolledList(unrolledList *);
+size_t ulSize(unrolledList *);
+void ulAppend(unrolledList *, int);
+void ulAppendN(unrolledList *, const int *, size_t);
+int ulGet(unrolledList *, size_t, int *);
+void ulInsertAtPos(unrolledList *, int, size_t);
+void ulDeleteAtPos(unrolledList *, size_t);
+long ulSearch(unrolledList *, int);   //position of the first matched key, -1 if none
+unrolledIterator ulBlocks(unrolledList *);
+const int* ulNextBlock(unrolledIterator *, int *);
+void ulDisplay(unrolledList *);
+
+
+int main(){
+
+    unrolledList list;
+    initUnrolledList(&list);
+
+    for(int i = 1; i <= 30; i++){
+        ulAppend(&list, i);
+    }
+    ulDisplay(&list);
+    ulInsertAtPos(&list, 100, 5);     // splits the first node
+    ulInsertAtPos(&list, 101, 0);
+    ulInsertAtPos(&list, 102, ulSize(&list));
+    ulDisplay(&list);
+    for(int i = 0; i < 10; i++){
+        ulDeleteAtPos(&list, 3);
+    }
+    ulDisplay(&list);
+    printf("Element 20 found at %ld position\n", ulSearch(&list, 20));
+    freeUnrolledList(&list);
+
+    // appending a million keys, then summing them block by block
+    int values[1000];
+    for(int i = 0; i < 1000; i++){
+        values[i] = i;
+    }
+    for(int i = 0; i < 1000; i++){
+        ulAppendN(&list, values, 1000);
+    }
+    long long sum = 0;
+    int count;
+    unrolledIterator it = ulBlocks(&list);
+    for(const int *keys; (keys = ulNextBlock(&it, &count)) != NULL;){
+        for(int i = 0; i < count; i++){
+            sum += keys[i];
+        }
+    }
+    printf("%zu keys in %zu nodes, %.2f bytes per key, sum %lld\n", ulSize(&list), list.nodes,
+           (double)(list.nodes * sizeof(unrolledNode)) / ulSize(&list), sum);
+    freeUnrolledList(&list);
+
+    return 0;
+}
+
+unrolledNode* newUnrolledNode(){
+    unrolledNode *n = aligned_alloc(CACHE_LINE, sizeof(unrolledNode));
+    n->next = NULL;
+    n->count = 0;
+    return n;
+}
+
+void initUnrolledList(unrolledList *list){
+    list->head = list->tail = NULL;
+    list->size = list->nodes = 0;
+}
+
+void freeUnrolledList(unrolledList *list){
+    unrolledNode *n = list->head;
+    while(n != NULL){
+        unrolledNode *next = n->next;
+        free(n);
+        n = next;
+    }
+    initUnrolledList(list);
+}
+
+size_t ulSize(unrolledList *list){
+    return list->size;
+}
+
+// Adds an empty node after the tail
+void appendNode(unrolledList *list){
+    unrolledNode *n = newUnrolledNode();
+    if(list->tail == NULL){
+        list->head = n;
+    }
+    else{
+        list->tail->next = n;
+    }
+    list->tail = n;
+    ++(list->nodes);
+}
+
+void ulAppend(unrolledList *list, int val){
+    if(list->tail == NULL || list->tail->count == (int)UNROLLED_CAPACITY){
+        appendNode(list);
+    }
+    list->tail->keys[list->tail->count++] = val;
+    ++(list->size);
+}
+
+void ulAppendN(unrolledList *list, const int *values, size_t n){
+    while(n > 0){
+        if(list->tail == NULL || list->tail->count == (int)UNROLLED_CAPACITY){
+            appendNode(list);
+        }
+        size_t room = UNROLLED_CAPACITY - list->tail->count;
+        size_t run = n < room ? n : room;
+        memcpy(list->tail->keys + list->tail->count, values, sizeof(int) * run);
+        list->tail->count += run;
+        list->size += run;
+        values += run;
+        n -= run;
+    }
+}
+
+// The node holding position *pos; *pos becomes the index inside that node
+unrolledNode* findNode(unrolledList *list, size_t *pos, unrolledNode **prev){
+    unrolledNode *n = list->head;
+    *prev = NULL;
+    while(n != NULL && *pos >= (size_t)n->count){
+        *pos -= n->count;
+        *prev = n;
+        n = n->next;
+    }
+    return n;
+}
+
+// Returns 0 if pos is out of range
+int ulGet(unrolledList *list, size_t pos, int *val){
+    unrolledNode *prev;
+    unrolledNode *n = findNode(list, &pos, &prev);
+    if(n == NULL){
+        return 0;
+    }
+    *val = n->keys[pos];
+    return 1;
+}
+
+// Moves the upper half of a full node n into a new node after it
+void splitNode(unrolledList *list, unrolledNode *n){
+    unrolledNode *half = newUnrolledNode();
+    int keep = n->count / 2;
+    half->count = n->count - keep;
+    memcpy(half->keys, n->keys + keep, sizeof(int) * half->count);
+    n->count = keep;
+    half->next = n->next;
+    n->next = half;
+    if(list->tail == n){
+        list->tail = half;
+    }
+    ++(list->nodes);
+}
+
+void ulInsertAtPos(unrolledList *list, int val, size_t pos){
+    if(pos > list->size){
+        printf("Position is out of range\n");
+        return;
+    }
+    if(pos == list->size){
+        ulAppend(list, val);
+        return;
+    }
+    unrolledNode *prev;
+    unrolledNode *n = findNode(list, &pos, &prev);
+    if(n->count == (int)UNROLLED_CAPACITY){
+        splitNode(list, n);
+        if(pos > (size_t)n->count){
+            pos -= n->count;
+            n = n->next;
+        }
+    }
+    memmove(n->keys + pos + 1, n->keys + pos, sizeof(int) * (n->count - pos));
+    n->keys[pos] = val;
+    ++(n->count);
+    ++(list->size);
+}
+
+void ulDeleteAtPos(unrolledList *list, size_t pos){
+    if(pos >= list->size){
+        printf("Position is out of range\n");
+        return;
+    }
+    unrolledNode *prev;
+    unrolledNode *n = findNode(list, &pos, &prev);
+    memmove(n->keys + pos, n->keys + pos + 1, sizeof(int) * (n->count - pos - 1));
+    --(n->count);
+    --(list->size);
+
+    unrolledNode *next = n->next;
+    if(n->count == 0){
+        // only the last node can get empty, the others are merged or refilled first
+        if(prev == NULL){
+            list->head = next;
+        }
+        else{
+            prev->next = next;
+        }
+        if(list->tail == n){
+            list->tail = prev;
+        }
+        free(n);
+        --(list->nodes);
+    }
+    else if(n->count < (int)UNROLLED_CAPACITY / 2 && next != NULL){
+        if(n->count + next->count <= (int)UNROLLED_CAPACITY){
+            // merge next into n
+            memcpy(n->keys + n->count, next->keys, sizeof(int) * next->count);
+            n->count += next->count;
+            n->next = next->next;
+            if(list->tail == next){
+                list->tail = n;
+            }
+            free(next);
+            --(list->nodes);
+        }
+        else{
+            // borrow from next, so that both stay at least half full
+            int moved = (next->count - n->count) / 2;
+            memcpy(n->keys + n->count, next->keys, sizeof(int) * moved);
+            n->count += moved;
+            memmove(next->keys, next->keys + moved, sizeof(int) * (next->count - moved));
+            next->count -= moved;
+        }
+    }
+}
+
+long ulSearch(unrolledList *list, int key){
+    long pos = 0;
+    for(unrolledNode *n = list->head; n != NULL; pos += n->count, n = n->next){
+        for(int i = 0; i < n->count; i++){
+            if(n->keys[i] == key){
+                return pos + i;
+            }
+        }
+    }
+    return -1;
+}
+
+unrolledIterator ulBlocks(unrolledList *list){
+    unrolledIterator it = {list->head};
+    return it;
+}
+
+// The keys of the next node and their number in *count; NULL after the last node
+const int* ulNextBlock(unrolledIterator *it, int *count){
+    unrolledNode *n = it->node;
+    if(n == NULL){
+        *count = 0;
+        return NULL;
+    }
+    it->node = n->next;
+    *count = n->count;
+    return n->keys;
+}
+
+void ulDisplay(unrolledList *list){
+    if(list->head == NULL){
+        printf("List is empty.\n\n");
+        return;
+    }
+    printf("The list is (%zu keys, %zu nodes):\n", list->size, list->nodes);
+    for(unrolledNode *n = list->head; n != NULL; n = n->next){
+        printf("[");
+        for(int i = 0; i < n->count; i++){
+            printf(i ? " %d" : "%d", n->keys[i]);
+        }
+        printf("] --> ");
+    }
+    printf("NULL\n\n");
+}
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 // Queue is a dynamic set, which implemenets FIFO policy (first-in, first-out)
 // We call the INSERT operation on a queue ENQUEUE, and we call the DELETE
@@ -10,7 +11,14 @@
 // the head of the queue, like the customer at the head of the line who has waited the
 // longest.
 //
-// Here we have 2 implementations: via a linked list and via an array.
+// Here we have 3 implementations: via a linked list, via an array and via a ring buffer.
+//
+// The ring buffer (ringQueue) is the one to use for many elements. The linked list mallocs a node per
+// element and chases a pointer per dequeue; the array never wraps around, so once tail reaches
+// MAXSIZE - 1 it reports overflow even if most of it was dequeued. ringQueue keeps the elements in one
+// array whose capacity is a power of two; head and tail only ever grow, and the slot of position i is
+// i & (capacity - 1), so wrapping around costs one AND. When the array is full it is doubled
+// (amortized O(1) per element), and enqueueN()/dequeueN() move whole runs with at most two memcpy()s.
 
 
 typedef struct queueNode {
@@ -115,6 +123,100 @@ void display_(queue_ *q){
 }
 
 
+#define RING_INITIAL_CAPACITY 16   // must be a power of two
+
+typedef struct RingQueue {
+    int *keys;
+    size_t capacity;           // power of two
+    size_t head, tail;         // positions, the slot is position & (capacity - 1)
+} ringQueue;
+
+ringQueue* createRingQueue(){
+    ringQueue *q = malloc(sizeof(ringQueue));
+    q->keys = malloc(sizeof(int) * RING_INITIAL_CAPACITY);
+    q->capacity = RING_INITIAL_CAPACITY;
+    q->head = q->tail = 0;
+    return q;
+}
+void freeRingQueue(ringQueue *q){
+    free(q->keys);
+    free(q);
+}
+size_t ringSize(ringQueue *q){
+    return q->tail - q->head;
+}
+// Copies n elements starting at position "from" out of the ring, in order
+void ringCopyOut(ringQueue *q, size_t from, int *dst, size_t n){
+    size_t first = from & (q->capacity - 1);
+    size_t run = q->capacity - first < n ? q->capacity - first : n;
+    memcpy(dst, q->keys + first, sizeof(int) * run);
+    memcpy(dst + run, q->keys, sizeof(int) * (n - run));
+}
+// Makes room for at least "needed" elements; the elements are moved to positions 0..size-1
+void ringReserve(ringQueue *q, size_t needed){
+    if(needed <= q->capacity){
+        return;
+    }
+    size_t capacity = q->capacity;
+    while(capacity < needed){
+        capacity *= 2;
+    }
+    int *keys = malloc(sizeof(int) * capacity);
+    size_t size = ringSize(q);
+    ringCopyOut(q, q->head, keys, size);
+    free(q->keys);
+    q->keys = keys;
+    q->capacity = capacity;
+    q->head = 0;
+    q->tail = size;
+}
+void enQueueRing(ringQueue *q, int k){
+    if(ringSize(q) == q->capacity){
+        ringReserve(q, q->capacity * 2);
+    }
+    q->keys[q->tail++ & (q->capacity - 1)] = k;
+}
+// Returns 0 if the queue is empty
+int deQueueRing(ringQueue *q, int *k){
+    if(q->head == q->tail){
+        return 0;
+    }
+    *k = q->keys[q->head++ & (q->capacity - 1)];
+    return 1;
+}
+void enqueueN(ringQueue *q, const int *keys, size_t n){
+    ringReserve(q, ringSize(q) + n);
+    size_t first = q->tail & (q->capacity - 1);
+    size_t run = q->capacity - first < n ? q->capacity - first : n;
+    memcpy(q->keys + first, keys, sizeof(int) * run);
+    memcpy(q->keys, keys + run, sizeof(int) * (n - run));
+    q->tail += n;
+}
+// Dequeues up to n elements into keys, returns how many
+size_t dequeueN(ringQueue *q, int *keys, size_t n){
+    if(n > ringSize(q)){
+        n = ringSize(q);
+    }
+    ringCopyOut(q, q->head, keys, n);
+    q->head += n;
+    return n;
+}
+void displayRing(ringQueue *q){
+    if(q->head == q->tail){
+        printf("Queue is empty\n");
+        return;
+    }
+    printf("Head: ");
+    for(size_t i = q->head; i != q->tail; i++){
+        printf("%d", q->keys[i & (q->capacity - 1)]);
+        if(i + 1 != q->tail){
+            printf(" --> ");
+        }
+    }
+    printf(" :Tail\n");
+}
+
+
 int main(int argc, char* argv[]){
 
 //     queue *q = createQueue();
@@ -139,4 +241,23 @@ int main(int argc, char* argv[]){
 //     deQueue_(&q);
 //     display_(&q);
 
+
+    ringQueue *r = createRingQueue();
+    for(int i = 1; i <= 12; i++){
+        enQueueRing(r, i);
+    }
+    int key, batch[32];
+    for(int i = 0; i < 10; i++){
+        deQueueRing(r, &key);
+    }
+    for(int i = 0; i < 30; i++){
+        batch[i] = 13 + i;
+    }
+    enqueueN(r, batch, 10);   // wraps around the end of the array
+    displayRing(r);
+    enqueueN(r, batch + 10, 20);   // grows to 32
+    size_t n = dequeueN(r, batch, 32);
+    printf("dequeued %zu, first %d, last %d, capacity %zu\n", n, batch[0], batch[n - 1], r->capacity);
+    displayRing(r);
+    freeRingQueue(r);
 }
@@ -0,0 +1,563 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+
+// Queues shared between threads, without locks (see queue.c for the single-threaded ones).
+// Three variants, from the most to the least specialized; each has single and batch operations.
+//
+// spscQueue - one producer thread and one consumer thread, a ring of power-of-two capacity.
+//  The producer only writes tail and the consumer only writes head, so each side needs one release
+//  store per operation and no read-modify-write at all (wait-free). head and tail are on different
+//  cache lines, and each side keeps a private copy of the other side's index (cachedHead,
+//  cachedTail), reading the real one only when the copy says that the ring is full (or empty).
+//  So in steady state the two threads do not touch each other's cache lines except for the data.
+//
+// mpmcQueue - any number of producers and consumers, bounded (Dmitry Vyukov's queue).
+//  Every cell has a sequence number that tells what the cell is waiting for: seq == pos means that it
+//  is free for the enqueue at position pos, seq == pos + 1 that it holds the element for the dequeue
+//  at position pos. A producer claims position pos by CAS on enqueuePos, writes the data and publishes
+//  it by setting seq = pos + 1; the consumer of pos sets seq = pos + capacity, which frees the cell for
+//  the next lap. One CAS per operation, and producers and consumers never contend on the same counter.
+//  A batch first checks how many consecutive cells are ready, then claims all of them with one CAS.
+//
+// segmentQueue - any number of producers and consumers, unbounded. A linked list of segments of
+//  SEGMENT_SIZE slots (the "FAA array queue" of Ramalhete and Correia). Instead of a CAS loop,
+//  enqueue and dequeue take an index with fetch-and-add on the segment's enqIdx/deqIdx:
+//  an enqueuer CASes its element into slot enqIdx (from EMPTY), a dequeuer swaps TAKEN into slot deqIdx.
+//  If the dequeuer came first, the enqueuer's CAS fails and it simply takes another index.
+//  When a segment is used up, a new one is linked after it. A batch takes several indices with one
+//  fetch-and-add. Segments that the head has passed are freed with hazard pointers: every thread
+//  publishes the segment it is working on in hazards[tid], and a retired segment is freed only when
+//  no thread has it published. So every thread using a segmentQueue needs a distinct tid < MAX_THREADS.
+
+#define CACHE_LINE 64
+#define SEGMENT_SIZE 1024
+#define MAX_THREADS 64
+#define RETIRE_SCAN (2 * MAX_THREADS)   // retired segments per thread before they are checked
+
+#define SLOT_EMPTY 0
+#define SLOT_TAKEN 1
+#define SLOT_FULL 2                     // low bits of a slot holding an element, the element is in the top 32 bits
+
+
+// Single producer, single consumer
+
+typedef struct SpscQueue {
+    _Alignas(CACHE_LINE) _Atomic size_t tail;     // written by the producer
+    size_t cachedHead;
+    _Alignas(CACHE_LINE) _Atomic size_t head;     // written by the consumer
+    size_t cachedTail;
+    _Alignas(CACHE_LINE) size_t mask;
+    int *keys;
+} spscQueue;
+
+// capacity must be a power of two
+spscQueue* createSpscQueue(size_t capacity){
+    spscQueue *q = aligned_alloc(CACHE_LINE, sizeof(spscQueue));
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    q->cachedHead = q->cachedTail = 0;
+    q->mask = capacity - 1;
+    q->keys = malloc(sizeof(int) * capacity);
+    return q;
+}
+void freeSpscQueue(spscQueue *q){
+    free(q->keys);
+    free(q);
+}
+// Producer side: enqueues up to n keys, returns how many fitted
+size_t spscEnqueueN(spscQueue *q, const int *keys, size_t n){
+    size_t t = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    size_t room = q->mask + 1 - (t - q->cachedHead);
+    if(room < n){
+        q->cachedHead = atomic_load_explicit(&q->head, memory_order_acquire);
+        room = q->mask + 1 - (t - q->cachedHead);
+        if(n > room){
+            n = room;
+        }
+    }
+    for(size_t i = 0; i < n; i++){
+        q->keys[(t + i) & q->mask] = keys[i];
+    }
+    atomic_store_explicit(&q->tail, t + n, memory_order_release);
+    return n;
+}
+int spscEnqueue(spscQueue *q, int k){
+    return spscEnqueueN(q, &k, 1) == 1;
+}
+// Consumer side: dequeues up to n keys, returns how many
+size_t spscDequeueN(spscQueue *q, int *keys, size_t n){
+    size_t h = atomic_load_explicit(&q->head, memory_order_relaxed);
+    if(q->cachedTail - h < n){
+        q->cachedTail = atomic_load_explicit(&q->tail, memory_order_acquire);
+        if(q->cachedTail - h < n){
+            n = q->cachedTail - h;
+        }
+    }
+    for(size_t i = 0; i < n; i++){
+        keys[i] = q->keys[(h + i) & q->mask];
+    }
+    atomic_store_explicit(&q->head, h + n, memory_order_release);
+    return n;
+}
+// Returns 0 if the queue is empty
+int spscDequeue(spscQueue *q, int *k){
+    return spscDequeueN(q, k, 1) == 1;
+}
+
+
+// Bounded, multiple producers and consumers
+
+typedef struct MpmcCell {
+    _Atomic size_t sequence;
+    int key;
+} mpmcCell;
+
+typedef struct MpmcQueue {
+    _Alignas(CACHE_LINE) _Atomic size_t enqueuePos;
+    _Alignas(CACHE_LINE) _Atomic size_t dequeuePos;
+    _Alignas(CACHE_LINE) size_t mask;
+    mpmcCell *cells;
+} mpmcQueue;
+
+// capacity must be a power of two
+mpmcQueue* createMpmcQueue(size_t capacity){
+    mpmcQueue *q = aligned_alloc(CACHE_LINE, sizeof(mpmcQueue));
+    q->mask = capacity - 1;
+    q->cells = malloc(sizeof(mpmcCell) * capacity);
+    for(size_t i = 0; i < capacity; i++){
+        atomic_init(&q->cells[i].sequence, i);
+    }
+    atomic_init(&q->enqueuePos, 0);
+    atomic_init(&q->dequeuePos, 0);
+    return q;
+}
+void freeMpmcQueue(mpmcQueue *q){
+    free(q->cells);
+    free(q);
+}
+// Claims up to n consecutive cells whose sequence is pos + ready (ready = 0 for enqueue, 1 for dequeue).
+// Returns how many were claimed, starting at *start; 0 if the queue is full (or empty)
+size_t mpmcClaim(mpmcQueue *q, _Atomic size_t *position, size_t ready, size_t n, size_t *start){
+    size_t pos = atomic_load_explicit(position, memory_order_relaxed);
+    for(;;){
+        size_t k = 0;
+        while(k < n){
+            size_t seq = atomic_load_explicit(&q->cells[(pos + k) & q->mask].sequence, memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + k + ready);
+            if(diff != 0){
+                if(k == 0 && diff < 0){
+                    return 0;
+                }
+                break;
+            }
+            k++;
+        }
+        if(k == 0){   // pos is stale, another thread got there first
+            pos = atomic_load_explicit(position, memory_order_relaxed);
+            continue;
+        }
+        if(atomic_compare_exchange_weak_explicit(position, &pos, pos + k, memory_order_relaxed, memory_order_relaxed)){
+            *start = pos;
+            return k;
+        }
+    }
+}
+size_t mpmcEnqueueN(mpmcQueue *q, const int *keys, size_t n){
+    size_t pos;
+    n = n ? mpmcClaim(q, &q->enqueuePos, 0, n, &pos) : 0;
+    for(size_t i = 0; i < n; i++){
+        mpmcCell *cell = &q->cells[(pos + i) & q->mask];
+        cell->key = keys[i];
+        atomic_store_explicit(&cell->sequence, pos + i + 1, memory_order_release);
+    }
+    return n;
+}
+int mpmcEnqueue(mpmcQueue *q, int k){
+    return mpmcEnqueueN(q, &k, 1) == 1;
+}
+size_t mpmcDequeueN(mpmcQueue *q, int *keys, size_t n){
+    size_t pos;
+    n = n ? mpmcClaim(q, &q->dequeuePos, 1, n, &pos) : 0;
+    for(size_t i = 0; i < n; i++){
+        mpmcCell *cell = &q->cells[(pos + i) & q->mask];
+        keys[i] = cell->key;
+        atomic_store_explicit(&cell->sequence, pos + i + q->mask + 1, memory_order_release);
+    }
+    return n;
+}
+// Returns 0 if the queue is empty
+int mpmcDequeue(mpmcQueue *q, int *k){
+    return mpmcDequeueN(q, k, 1) == 1;
+}
+
+
+// Unbounded, multiple producers and consumers
+
+typedef struct Segment {
+    _Alignas(CACHE_LINE) _Atomic size_t deqIdx;
+    _Alignas(CACHE_LINE) _Atomic size_t enqIdx;
+    _Alignas(CACHE_LINE) _Atomic(struct Segment*) next;
+    _Atomic uint64_t slots[SEGMENT_SIZE];
+} segment;
+
+typedef struct Hazard {
+    _Alignas(CACHE_LINE) _Atomic(segment*) segment;
+} hazard;
+
+typedef struct RetiredList {
+    segment **segments;
+    size_t count, size;
+} retiredList;
+
+typedef struct SegmentQueue {
+    _Alignas(CACHE_LINE) _Atomic(segment*) head;
+    _Alignas(CACHE_LINE) _Atomic(segment*) tail;
+    hazard hazards[MAX_THREADS];
+    retiredList retired[MAX_THREADS];
+} segmentQueue;
+
+uint64_t packSlot(int k){
+    return ((uint64_t)(uint32_t)k << 32) | SLOT_FULL;
+}
+int unpackSlot(uint64_t slot){
+    return (int)(uint32_t)(slot >> 32);
+}
+
+segment* newSegment(){
+    segment *s = aligned_alloc(CACHE_LINE, sizeof(segment));
+    atomic_init(&s->deqIdx, 0);
+    atomic_init(&s->enqIdx, 0);
+    atomic_init(&s->next, NULL);
+    for(int i = 0; i < SEGMENT_SIZE; i++){
+        atomic_init(&s->slots[i], SLOT_EMPTY);
+    }
+    return s;
+}
+
+segmentQueue* createSegmentQueue(){
+    segmentQueue *q = aligned_alloc(CACHE_LINE, sizeof(segmentQueue));
+    segment *s = newSegment();
+    atomic_init(&q->head, s);
+    atomic_init(&q->tail, s);
+    for(int t = 0; t < MAX_THREADS; t++){
+        atomic_init(&q->hazards[t].segment, NULL);
+        q->retired[t].segments = NULL;
+        q->retired[t].count = q->retired[t].size = 0;
+    }
+    return q;
+}
+// No other thread may use the queue any more
+void freeSegmentQueue(segmentQueue *q){
+    segment *s = atomic_load(&q->head);
+    while(s != NULL){
+        segment *next = atomic_load(&s->next);
+        free(s);
+        s = next;
+    }
+    for(int t = 0; t < MAX_THREADS; t++){
+        for(size_t i = 0; i < q->retired[t].count; i++){
+            free(q->retired[t].segments[i]);
+        }
+        free(q->retired[t].segments);
+    }
+    free(q);
+}
+
+// Reads *src and publishes it as thread tid's hazard; the segment cannot be freed until the hazard is cleared
+segment* protect(segmentQueue *q, int tid, _Atomic(segment*) *src){
+    segment *s = atomic_load(src);
+    for(;;){
+        atomic_store(&q->hazards[tid].segment, s);
+        segment *again = atomic_load(src);
+        if(again == s){
+            return s;
+        }
+        s = again;
+    }
+}
+void clearHazard(segmentQueue *q, int tid){
+    atomic_store_explicit(&q->hazards[tid].segment, NULL, memory_order_release);
+}
+void retire(segmentQueue *q, int tid, segment *s){
+    retiredList *list = &q->retired[tid];
+    if(list->count == list->size){
+        list->size = list->size ? list->size * 2 : RETIRE_SCAN;
+        list->segments = realloc(list->segments, sizeof(segment*) * list->size);
+    }
+    list->segments[list->count++] = s;
+    if(list->count < RETIRE_SCAN){
+        return;
+    }
+    size_t kept = 0;
+    for(size_t i = 0; i < list->count; i++){
+        int inUse = 0;
+        for(int t = 0; t < MAX_THREADS && !inUse; t++){
+            inUse = atomic_load(&q->hazards[t].segment) == list->segments[i];
+        }
+        if(inUse){
+            list->segments[kept++] = list->segments[i];
+        }
+        else{
+            free(list->segments[i]);
+        }
+    }
+    list->count = kept;
+}
+
+// The tail segment t is used up: link a new segment holding keys[0..n-1] (n <= SEGMENT_SIZE) after it,
+// or help to move the tail if another thread already did. Returns how many keys were stored
+size_t appendSegment(segmentQueue *q, segment *t, const int *keys, size_t n){
+    if(t != atomic_load(&q->tail)){
+        return 0;
+    }
+    segment *next = atomic_load(&t->next);
+    if(next != NULL){
+        atomic_compare_exchange_strong(&q->tail, &t, next);
+        return 0;
+    }
+    segment *s = newSegment();
+    for(size_t i = 0; i < n; i++){
+        atomic_init(&s->slots[i], packSlot(keys[i]));
+    }
+    atomic_init(&s->enqIdx, n);
+    if(atomic_compare_exchange_strong(&t->next, &next, s)){
+        atomic_compare_exchange_strong(&q->tail, &t, s);
+        return n;
+    }
+    free(s);
+    return 0;
+}
+
+// Enqueues keys[0..n-1] in this order; tid identifies the calling thread
+void segmentEnqueueN(segmentQueue *q, int tid, const int *keys, size_t n){
+    size_t done = 0;
+    while(done < n){
+        segment *t = protect(q, tid, &q->tail);
+        size_t want = n - done < SEGMENT_SIZE ? n - done : SEGMENT_SIZE;
+        size_t idx = atomic_fetch_add(&t->enqIdx, want);
+        if(idx >= SEGMENT_SIZE){
+            done += appendSegment(q, t, keys + done, want);
+            continue;
+        }
+        size_t end = idx + want < SEGMENT_SIZE ? idx + want : SEGMENT_SIZE;
+        for(size_t i = idx; i < end && done < n; i++){
+            uint64_t expected = SLOT_EMPTY;
+            // fails if a dequeuer has already given up on this slot, the key then tries the next one
+            if(atomic_compare_exchange_strong(&t->slots[i], &expected, packSlot(keys[done]))){
+                done++;
+            }
+        }
+    }
+    clearHazard(q, tid);
+}
+void segmentEnqueue(segmentQueue *q, int tid, int k){
+    segmentEnqueueN(q, tid, &k, 1);
+}
+
+// Dequeues up to n keys into keys, returns how many
+size_t segmentDequeueN(segmentQueue *q, int tid, int *keys, size_t n){
+    size_t got = 0;
+    while(got < n){
+        segment *h = protect(q, tid, &q->head);
+        size_t d = atomic_load(&h->deqIdx), e = atomic_load(&h->enqIdx);
+        if(d >= e && atomic_load(&h->next) == NULL){
+            break;
+        }
+        size_t want = n - got;
+        if(e > d && e - d < want){
+            want = e - d;
+        }
+        else if(e <= d){
+            want = 1;
+        }
+        size_t idx = atomic_fetch_add(&h->deqIdx, want);
+        if(idx >= SEGMENT_SIZE){
+            segment *next = atomic_load(&h->next);
+            if(next == NULL){
+                break;
+            }
+            segment *t = h;   // the tail must not stay behind on a segment that is about to be freed
+            atomic_compare_exchange_strong(&q->tail, &t, next);
+            segment *expected = h;
+            if(atomic_compare_exchange_strong(&q->head, &expected, next)){
+                clearHazard(q, tid);
+                retire(q, tid, h);
+            }
+            continue;
+        }
+        size_t end = idx + want < SEGMENT_SIZE ? idx + want : SEGMENT_SIZE;
+        for(size_t i = idx; i < end; i++){
+            uint64_t slot = atomic_exchange(&h->slots[i], SLOT_TAKEN);
+            if(slot != SLOT_EMPTY){
+                keys[got++] = unpackSlot(slot);
+            }
+        }
+    }
+    clearHazard(q, tid);
+    return got;
+}
+// Returns 0 if the queue is empty
+int segmentDequeue(segmentQueue *q, int tid, int *k){
+    return segmentDequeueN(q, tid, k, 1) == 1;
+}
+
+
+// Demo: producers send 0..ITEMS-1 each, consumers add up what they receive
+
+#define ITEMS 1000000
+#define PRODUCERS 2
+#define CONSUMERS 2
+#define BATCH 64
+
+spscQueue *spsc;
+mpmcQueue *mpmc;
+segmentQueue *segments;
+_Atomic long long received;
+_Atomic int producersLeft;
+
+void* spscProducer(void* arg){
+    (void)arg;
+    int keys[BATCH];
+    for(int i = 0; i < ITEMS; i += BATCH){
+        for(int j = 0; j < BATCH; j++){
+            keys[j] = i + j;
+        }
+        for(size_t sent = 0; sent < BATCH; ){
+            size_t n = spscEnqueueN(spsc, keys + sent, BATCH - sent);
+            sent += n;
+            if(n == 0){
+                sched_yield();
+            }
+        }
+    }
+    return NULL;
+}
+void* spscConsumer(void* arg){
+    (void)arg;
+    int keys[BATCH], expect = 0;
+    while(expect < ITEMS){
+        size_t n = spscDequeueN(spsc, keys, BATCH);
+        for(size_t j = 0; j < n; j++){
+            if(keys[j] != expect++){
+                printf("SPSC order broken\n");
+            }
+        }
+        if(n == 0){
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+void* mpmcProducer(void* arg){
+    (void)arg;
+    for(int i = 0; i < ITEMS; i++){
+        while(!mpmcEnqueue(mpmc, i)){
+            sched_yield();
+        }
+    }
+    atomic_fetch_sub(&producersLeft, 1);
+    return NULL;
+}
+void* mpmcConsumer(void* arg){
+    (void)arg;
+    int keys[BATCH];
+    long long sum = 0;
+    for(;;){
+        size_t n = mpmcDequeueN(mpmc, keys, BATCH);
+        for(size_t j = 0; j < n; j++){
+            sum += keys[j];
+        }
+        if(n == 0){
+            if(atomic_load(&producersLeft) == 0){
+                while((n = mpmcDequeueN(mpmc, keys, BATCH)) > 0){
+                    for(size_t j = 0; j < n; j++){
+                        sum += keys[j];
+                    }
+                }
+                break;
+            }
+            sched_yield();
+        }
+    }
+    atomic_fetch_add(&received, sum);
+    return NULL;
+}
+
+void* segmentProducer(void* arg){
+    int tid = (int)(long)arg;
+    int keys[BATCH];
+    for(int i = 0; i < ITEMS; i += BATCH){
+        for(int j = 0; j < BATCH; j++){
+            keys[j] = i + j;
+        }
+        segmentEnqueueN(segments, tid, keys, BATCH);
+    }
+    atomic_fetch_sub(&producersLeft, 1);
+    return NULL;
+}
+void* segmentConsumer(void* arg){
+    int tid = (int)(long)arg;
+    int keys[BATCH];
+    long long sum = 0;
+    for(;;){
+        size_t n = segmentDequeueN(segments, tid, keys, BATCH);
+        for(size_t j = 0; j < n; j++){
+            sum += keys[j];
+        }
+        if(n == 0){
+            if(atomic_load(&producersLeft) == 0){
+                // every enqueue has finished, so what is left can be drained
+                while((n = segmentDequeueN(segments, tid, keys, BATCH)) > 0){
+                    for(size_t j = 0; j < n; j++){
+                        sum += keys[j];
+                    }
+                }
+                break;
+            }
+            sched_yield();
+        }
+    }
+    atomic_fetch_add(&received, sum);
+    return NULL;
+}
+
+void runThreads(void* (*producer)(void*), void* (*consumer)(void*), int producers, int consumers){
+    pthread_t threads[PRODUCERS + CONSUMERS];
+    atomic_store(&received, 0);
+    atomic_store(&producersLeft, producers);
+    for(long t = 0; t < producers; t++){
+        pthread_create(&threads[t], NULL, producer, (void*)t);
+    }
+    for(long t = 0; t < consumers; t++){
+        pthread_create(&threads[producers + t], NULL, consumer, (void*)(producers + t));
+    }
+    for(int t = 0; t < producers + consumers; t++){
+        pthread_join(threads[t], NULL);
+    }
+}
+
+
+int main(int argc, char* argv[]){
+    long long expected = (long long)ITEMS * (ITEMS - 1) / 2 * PRODUCERS;
+
+    spsc = createSpscQueue(1024);
+    runThreads(spscProducer, spscConsumer, 1, 1);
+    printf("SPSC: %d keys passed in order\n", ITEMS);
+    freeSpscQueue(spsc);
+
+    mpmc = createMpmcQueue(1024);
+    runThreads(mpmcProducer, mpmcConsumer, PRODUCERS, CONSUMERS);
+    printf("bounded MPMC: received sum %lld, expected %lld\n", atomic_load(&received), expected);
+    freeMpmcQueue(mpmc);
+
+    segments = createSegmentQueue();
+    runThreads(segmentProducer, segmentConsumer, PRODUCERS, CONSUMERS);
+    printf("unbounded MPMC: received sum %lld, expected %lld\n", atomic_load(&received), expected);
+    freeSegmentQueue(segments);
+}
@@ -1,5 +1,10 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
 
 // Stack is a dynamic set, which implemenets LIFO policy (last-in, first-out)
 // The INSERT operation on a stack is often called PUSH, and the DELETE operation,
@@ -11,7 +16,35 @@
 // In every implementation of stack there is an attribute TOP, that indexes (or points to)
 // the most recently inserted (pushed) element.
  
-// Here we have 2 implementations: via a linked list and via an array.
+// Here we have 3 implementations: via a linked list, via a fixed array and via a growable array.
+//
+// The growable array (growableStack) is the one to use as the explicit stack of an iterative
+// algorithm (DFS, tree traversals). The linked list mallocs and frees a node on every push and pop,
+// which costs far more than the push itself; the fixed array holds MAXSIZE elements only.
+// growableStack keeps the elements contiguously and doubles the array when it is full, so a push is
+// amortized O(1) and no allocation happens at all once the stack has reached its largest size.
+// The first STACK_INLINE elements live inside the struct itself (small-buffer optimization), so a
+// growableStack declared as a local variable, whose depth usually stays small, never calls malloc.
+// stackReserve() makes room in advance, pushN()/popN() move whole runs with one memcpy().
+//
+// treiberStack can be shared between threads (R. K. Treiber, 1986): top is changed with one CAS, and a
+// thread whose CAS failed reads top again and retries. Without locks, but two problems have to be solved:
+//  ABA - thread 1 reads top = A and next = B and is suspended; meanwhile A and B are popped and A is
+//  pushed again. Thread 1's CAS(top, A, B) still succeeds and makes the freed B the top. So top is a
+//  64-bit word holding the node (an index into the stack's own node array) and a tag that is
+//  incremented on every change: the stale CAS sees another tag and fails;
+//  reclamation - a thread may read next from a node that another thread has just popped. The nodes are
+//  never free()'d while the stack exists: popped nodes go to a free list (another Treiber stack over the
+//  same array), so such a read returns garbage at worst, and the CAS then fails because of the tag.
+//  The stack holds at most "capacity" elements, a push to a full one returns 0.
+// Under contention all threads fight for the one top word. So a thread whose CAS failed first tries the
+// elimination array (Hendler, Shavit and Yerushalmi, 2004): a push waits for a moment in a random slot,
+// and a pop looks at up to ELIMINATION_PROBES slots for a waiting push and takes its value directly.
+// A push followed at once by a pop leaves the stack as it was, so this pair never needs to touch top
+// at all. The busier the stack is, the more pairs meet, so it scales where plain retrying does not.
+// The waiting push yields the processor now and then, so that on a machine with fewer cores than
+// threads the pop it waits for gets a chance to run. eliminationTest() in main() runs pushes and pops
+// through the array alone and checks that every value is delivered exactly once.
 
 typedef struct Node{
     int data;
@@ -92,6 +125,334 @@ void display_(stack *s){
 }
 
 
+#define STACK_INLINE 16
+
+typedef struct GrowableStack{
+    int *keys;                     // inlineKeys until the stack outgrows them (so do not copy the struct)
+    size_t size, capacity;
+    int inlineKeys[STACK_INLINE];
+} growableStack;
+
+void initGrowableStack(growableStack *s){
+    s->keys = s->inlineKeys;
+    s->size = 0;
+    s->capacity = STACK_INLINE;
+}
+void freeGrowableStack(growableStack *s){
+    if(s->keys != s->inlineKeys){
+        free(s->keys);
+    }
+    initGrowableStack(s);
+}
+// Makes room for at least "needed" elements
+void stackReserve(growableStack *s, size_t needed){
+    if(needed <= s->capacity){
+        return;
+    }
+    size_t capacity = s->capacity;
+    while(capacity < needed){
+        capacity *= 2;
+    }
+    if(s->keys == s->inlineKeys){
+        s->keys = malloc(sizeof(int) * capacity);
+        memcpy(s->keys, s->inlineKeys, sizeof(int) * s->size);
+    }
+    else{
+        s->keys = realloc(s->keys, sizeof(int) * capacity);
+    }
+    s->capacity = capacity;
+}
+void pushGrowable(growableStack *s, int value){
+    if(s->size == s->capacity){
+        stackReserve(s, s->capacity * 2);
+    }
+    s->keys[s->size++] = value;
+}
+// Returns 0 if the stack is empty
+int popGrowable(growableStack *s, int *value){
+    if(s->size == 0){
+        return 0;
+    }
+    *value = s->keys[--(s->size)];
+    return 1;
+}
+// Returns 0 if the stack is empty
+int peekGrowable(growableStack *s, int *value){
+    if(s->size == 0){
+        return 0;
+    }
+    *value = s->keys[s->size - 1];
+    return 1;
+}
+// Pushes values[0], values[1], ..., so values[n - 1] ends up on top
+void pushN(growableStack *s, const int *values, size_t n){
+    stackReserve(s, s->size + n);
+    memcpy(s->keys + s->size, values, sizeof(int) * n);
+    s->size += n;
+}
+// Pops up to n elements, returns how many. They are written bottom to top, as pushN() takes them:
+// values[count - 1] was the top, so pushN(s, values, count) undoes the popN()
+size_t popN(growableStack *s, int *values, size_t n){
+    if(n > s->size){
+        n = s->size;
+    }
+    s->size -= n;
+    memcpy(values, s->keys + s->size, sizeof(int) * n);
+    return n;
+}
+void displayGrowable(growableStack *s){
+    if(s->size == 0){
+        printf("Stack is Empty\n");
+        return;
+    }
+    for(size_t i = s->size; i-- > 0;){
+        printf("%d --> ", s->keys[i]);
+    }
+    printf("NULL\n");
+}
+
+
+#define ELIMINATION_SLOTS 8
+#define ELIMINATION_SPINS 256      // how long a push waits in a slot for a pop
+#define ELIMINATION_YIELD 64       // spins between two sched_yield() of a waiting push
+#define ELIMINATION_PROBES 4       // slots a pop looks at
+#define CACHE_LINE 64
+
+#define SLOT_EMPTY 0
+#define SLOT_PUSH 1                // low bits of a slot holding a waiting push, the value is in the top 32 bits
+#define SLOT_TAKEN 2               // a pop took the value, the push may leave
+
+typedef struct TreiberNode{
+    int data;
+    _Atomic uint32_t next;         // index + 1 of the next node, 0 for none
+} treiberNode;
+
+typedef struct EliminationSlot{
+    _Alignas(CACHE_LINE) _Atomic uint64_t state;
+} eliminationSlot;
+
+typedef struct TreiberStack{
+    _Alignas(CACHE_LINE) _Atomic uint64_t top;       // tag << 32 | (index + 1) of the top node
+    _Alignas(CACHE_LINE) _Atomic uint64_t freeList;  // the unused nodes, the same way
+    _Alignas(CACHE_LINE) treiberNode *nodes;
+    uint32_t capacity;
+    _Atomic unsigned long eliminated;                // pushes that met a pop in the elimination array
+    eliminationSlot slots[ELIMINATION_SLOTS];
+} treiberStack;
+
+static _Thread_local unsigned int eliminationSeed = 0;
+
+treiberStack* createTreiberStack(uint32_t capacity){
+    treiberStack *s = aligned_alloc(CACHE_LINE, sizeof(treiberStack));
+    s->nodes = malloc(sizeof(treiberNode) * capacity);
+    s->capacity = capacity;
+    for(uint32_t i = 0; i < capacity; i++){
+        atomic_init(&s->nodes[i].next, i + 1 < capacity ? i + 2 : 0);
+    }
+    atomic_init(&s->top, 0);
+    atomic_init(&s->freeList, capacity ? 1 : 0);
+    atomic_init(&s->eliminated, 0);
+    for(int i = 0; i < ELIMINATION_SLOTS; i++){
+        atomic_init(&s->slots[i].state, SLOT_EMPTY);
+    }
+    return s;
+}
+// No other thread may use the stack any more
+void freeTreiberStack(treiberStack *s){
+    free(s->nodes);
+    free(s);
+}
+
+// One attempt to put node (index + 1) on the list; 0 if another thread changed the list meanwhile
+int tryPushNode(treiberStack *s, _Atomic uint64_t *list, uint32_t node){
+    uint64_t old = atomic_load_explicit(list, memory_order_relaxed);
+    atomic_store_explicit(&s->nodes[node - 1].next, (uint32_t)old, memory_order_relaxed);
+    uint64_t new = ((old >> 32) + 1) << 32 | node;
+    return atomic_compare_exchange_strong_explicit(list, &old, new, memory_order_release, memory_order_relaxed);
+}
+// One attempt to take the first node off the list: its index + 1, 0 if the list is empty
+// and -1 if another thread changed the list meanwhile
+int64_t tryPopNode(treiberStack *s, _Atomic uint64_t *list){
+    uint64_t old = atomic_load_explicit(list, memory_order_acquire);
+    uint32_t node = (uint32_t)old;
+    if(node == 0){
+        return 0;
+    }
+    // the node may be popped and reused by now, then next is stale, but the tag has changed too
+    uint32_t next = atomic_load_explicit(&s->nodes[node - 1].next, memory_order_relaxed);
+    uint64_t new = ((old >> 32) + 1) << 32 | next;
+    if(!atomic_compare_exchange_strong_explicit(list, &old, new, memory_order_acquire, memory_order_relaxed)){
+        return -1;
+    }
+    return node;
+}
+
+eliminationSlot* randomSlot(treiberStack *s){
+    if(eliminationSeed == 0){
+        eliminationSeed = (unsigned int)(uintptr_t)&eliminationSeed | 1;
+    }
+    return &s->slots[rand_r(&eliminationSeed) % ELIMINATION_SLOTS];
+}
+// A push waits in a slot; 1 if a pop took the value
+int eliminatePush(treiberStack *s, int value){
+    eliminationSlot *slot = randomSlot(s);
+    uint64_t expected = SLOT_EMPTY;
+    uint64_t offer = ((uint64_t)(uint32_t)value << 32) | SLOT_PUSH;
+    if(!atomic_compare_exchange_strong(&slot->state, &expected, offer)){
+        return 0;
+    }
+    for(int i = 1; i <= ELIMINATION_SPINS; i++){
+        if(atomic_load_explicit(&slot->state, memory_order_acquire) == SLOT_TAKEN){
+            break;
+        }
+        if(i % ELIMINATION_YIELD == 0){
+            sched_yield();
+        }
+    }
+    // withdraw the offer; if that fails, a pop has taken it
+    if(atomic_compare_exchange_strong(&slot->state, &offer, SLOT_EMPTY)){
+        return 0;
+    }
+    atomic_store_explicit(&slot->state, SLOT_EMPTY, memory_order_release);
+    atomic_fetch_add_explicit(&s->eliminated, 1, memory_order_relaxed);
+    return 1;
+}
+// A pop looks for a waiting push in ELIMINATION_PROBES slots from a random one; 1 if it took a value
+int eliminatePop(treiberStack *s, int *value){
+    eliminationSlot *first = randomSlot(s);
+    for(int i = 0; i < ELIMINATION_PROBES; i++){
+        eliminationSlot *slot = &s->slots[(first - s->slots + i) % ELIMINATION_SLOTS];
+        uint64_t state = atomic_load_explicit(&slot->state, memory_order_acquire);
+        if((state & 3) == SLOT_PUSH && atomic_compare_exchange_strong(&slot->state, &state, SLOT_TAKEN)){
+            *value = (int)(uint32_t)(state >> 32);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Returns 0 if the stack is full
+int treiberPush(treiberStack *s, int value){
+    int64_t node;
+    while((node = tryPopNode(s, &s->freeList)) < 0){
+    }
+    if(node == 0){
+        return 0;
+    }
+    s->nodes[node - 1].data = value;
+    while(!tryPushNode(s, &s->top, (uint32_t)node)){
+        if(eliminatePush(s, value)){
+            // the value went to a pop directly, the node is not needed
+            while(!tryPushNode(s, &s->freeList, (uint32_t)node)){
+            }
+            return 1;
+        }
+    }
+    return 1;
+}
+// Returns 0 if the stack is empty
+int treiberPop(treiberStack *s, int *value){
+    int64_t node;
+    while((node = tryPopNode(s, &s->top)) < 0){
+        if(eliminatePop(s, value)){
+            return 1;
+        }
+    }
+    if(node == 0){
+        return 0;
+    }
+    *value = s->nodes[node - 1].data;
+    while(!tryPushNode(s, &s->freeList, (uint32_t)node)){
+    }
+    return 1;
+}
+
+
+#define THREADS 4
+#define OPERATIONS 200000
+#define EXCHANGES 20000            // values every pushing thread of eliminationTest() hands over
+
+typedef struct StackWorker{
+    treiberStack *s;
+    int id;
+    long long pushedSum, poppedSum;
+} stackWorker;
+
+// Every thread pushes its own values and pops as many times; the sums must match in the end
+void* treiberWorker(void *arg){
+    stackWorker *w = arg;
+    int value;
+    w->pushedSum = w->poppedSum = 0;
+    for(int i = 0; i < OPERATIONS; i++){
+        int v = w->id * OPERATIONS + i;
+        if(treiberPush(w->s, v)){
+            w->pushedSum += v;
+        }
+        if(treiberPop(w->s, &value)){
+            w->poppedSum += value;
+        }
+    }
+    return NULL;
+}
+
+typedef struct ExchangeWorker{
+    treiberStack *s;
+    int id;
+    _Atomic int *delivered;        // per value, how many pops received it
+    _Atomic int *received;         // values received by all pops
+} exchangeWorker;
+
+// Hands values id * EXCHANGES .. id * EXCHANGES + EXCHANGES - 1 to pops through the elimination array only
+void* exchangePusher(void *arg){
+    exchangeWorker *w = arg;
+    for(int i = 0; i < EXCHANGES; i++){
+        while(!eliminatePush(w->s, w->id * EXCHANGES + i)){
+        }
+    }
+    return NULL;
+}
+void* exchangePopper(void *arg){
+    exchangeWorker *w = arg;
+    int value;
+    while(atomic_load(w->received) < THREADS / 2 * EXCHANGES){
+        if(eliminatePop(w->s, &value)){
+            atomic_fetch_add(&w->delivered[value], 1);
+            atomic_fetch_add(w->received, 1);
+        }
+        else{
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+// THREADS / 2 threads push through the elimination array and as many pop from it, without the stack
+// itself; returns 1 if every value was received exactly once and every exchange was counted
+int eliminationTest(){
+    treiberStack *s = createTreiberStack(0);
+    int values = THREADS / 2 * EXCHANGES;
+    _Atomic int *delivered = calloc(values, sizeof(_Atomic int));
+    _Atomic int received = 0;
+    pthread_t threads[THREADS];
+    exchangeWorker workers[THREADS];
+    for(int t = 0; t < THREADS; t++){
+        workers[t] = (exchangeWorker){s, t / 2, delivered, &received};
+        pthread_create(&threads[t], NULL, t % 2 ? exchangePopper : exchangePusher, &workers[t]);
+    }
+    for(int t = 0; t < THREADS; t++){
+        pthread_join(threads[t], NULL);
+    }
+    int ok = atomic_load(&s->eliminated) == (unsigned long)values;
+    for(int v = 0; v < values; v++){
+        ok = ok && atomic_load(&delivered[v]) == 1;
+    }
+    printf("Elimination array: %lu values exchanged, each received once: %d\n", atomic_load(&s->eliminated), ok);
+    free(delivered);
+    freeTreiberStack(s);
+    return ok;
+}
+
+
 int main(int argc, char* argv[]){
     
 //     node *top = NULL;
@@ -115,5 +476,50 @@ int main(int argc, char* argv[]){
 //     pop_(&myStack);
 //     pop_(&myStack);
 //     display_(&myStack);
-    
+
+
+    growableStack gs;
+    initGrowableStack(&gs);
+    for(int i = 1; i <= 5; i++){
+        pushGrowable(&gs, i);
+    }
+    displayGrowable(&gs);
+    int values[40], value;
+    for(int i = 0; i < 40; i++){
+        values[i] = 100 + i;
+    }
+    pushN(&gs, values, 40);                // outgrows the inline buffer
+    size_t popped = popN(&gs, values, 38);
+    printf("Popped %zu, top was %d\n", popped, values[popped - 1]);
+    while(popGrowable(&gs, &value)){
+        printf("%d ", value);
+    }
+    printf("\n");
+    displayGrowable(&gs);
+    freeGrowableStack(&gs);
+
+
+    treiberStack *ts = createTreiberStack(1024);
+    pthread_t threads[THREADS];
+    stackWorker workers[THREADS];
+    for(int t = 0; t < THREADS; t++){
+        workers[t].s = ts;
+        workers[t].id = t;
+        pthread_create(&threads[t], NULL, treiberWorker, &workers[t]);
+    }
+    long long pushedSum = 0, poppedSum = 0;
+    for(int t = 0; t < THREADS; t++){
+        pthread_join(threads[t], NULL);
+        pushedSum += workers[t].pushedSum;
+        poppedSum += workers[t].poppedSum;
+    }
+    while(treiberPop(ts, &value)){
+        poppedSum += value;
+    }
+    printf("Treiber stack: pushed %lld, popped %lld, %lu eliminated\n",
+           pushedSum, poppedSum, atomic_load(&ts->eliminated));
+    freeTreiberStack(ts);
+
+    eliminationTest();
+
 }
@@ -0,0 +1,286 @@
+#ifndef WORK_STEALING_H
+#define WORK_STEALING_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+
+// Work-stealing deque and a small fork-join pool on top of it, for running the recursive
+// divide-and-conquer algorithms of this repo (merge sort, quicksort, maximum subarray) on several threads.
+//
+// workDeque - the Chase-Lev deque ("Dynamic Circular Work-Stealing Deque", 2005, with the C11 memory
+//  orders of Le, Pop, Cohen and Zappa Nardelli, 2013). It belongs to one thread, the owner, which pushes
+//  and pops tasks at the bottom like a stack (stack.c); any other thread may steal the oldest task from
+//  the top like from a queue (queue.c). The owner's push is one release store and its pop needs a CAS
+//  only when one task is left, since only then it can race with a thief; thieves take a task with one
+//  CAS on top. The tasks are in a circular array whose size is a power of two, and a full array is
+//  replaced by one twice as large. A thief may still be reading the old array, so old arrays are kept
+//  in a list and freed together with the deque.
+//
+// forkJoinPool - threads - 1 workers plus the thread that calls forkJoinRun(), each with its own deque.
+//  forkJoinSpawn(task, run, arg) pushes a task on the deque of the calling thread; it will be run either
+//  by this thread, at forkJoinSync(task), or by an idle worker that steals it. While it waits for a stolen
+//  task, forkJoinSync() runs other tasks (its own first, then stolen ones) instead of blocking.
+//  The old tasks at the top of a deque are the big subproblems, near the root of the recursion, so a thief
+//  takes a lot of work with one steal, while the owner works on the small ones at the bottom.
+//  The task struct belongs to the caller (usually a local variable of the spawning function) and must
+//  live until forkJoinSync(task) returns. Called outside forkJoinRun(), forkJoinSpawn() runs the task at once,
+//  so the parallel functions also work, sequentially, without a pool.
+//  Only one forkJoinRun() at a time per pool; workers sleep on a condition variable between runs.
+
+#define WORK_DEQUE_INITIAL_SIZE 64
+#define FORK_JOIN_SPINS 64      // failed steals before a waiting thread yields the processor
+
+typedef struct DequeArray{
+    int64_t size;                        // a power of two
+    struct DequeArray* previous;         // replaced by this one, freed with the deque
+    _Atomic(void*) items[];
+} dequeArray;
+
+typedef struct WorkDeque{
+    _Alignas(64) atomic_llong top;       // written by the thieves
+    _Alignas(64) atomic_llong bottom;    // written by the owner
+    _Atomic(dequeArray*) array;
+} workDeque;
+
+static inline dequeArray* newDequeArray(int64_t size, dequeArray* previous){
+    dequeArray* a = malloc(sizeof(dequeArray) + sizeof(_Atomic(void*)) * size);
+    a->size = size;
+    a->previous = previous;
+    return a;
+}
+
+static inline void workDequeInit(workDeque* q){
+    atomic_init(&q->top, 0);
+    atomic_init(&q->bottom, 0);
+    atomic_init(&q->array, newDequeArray(WORK_DEQUE_INITIAL_SIZE, NULL));
+}
+
+static inline void workDequeFree(workDeque* q){
+    dequeArray* a = atomic_load_explicit(&q->array, memory_order_relaxed);
+    while(a != NULL){
+        dequeArray* previous = a->previous;
+        free(a);
+        a = previous;
+    }
+}
+
+// Owner only
+static inline void workDequePush(workDeque* q, void* item){
+    int64_t b = atomic_load_explicit(&q->bottom, memory_order_relaxed);
+    int64_t t = atomic_load_explicit(&q->top, memory_order_acquire);
+    dequeArray* a = atomic_load_explicit(&q->array, memory_order_relaxed);
+    if(b - t > a->size - 1){
+        dequeArray* grown = newDequeArray(2 * a->size, a);
+        for(int64_t i = t; i < b; i++){
+            atomic_store_explicit(&grown->items[i & (grown->size - 1)],
+                                  atomic_load_explicit(&a->items[i & (a->size - 1)], memory_order_relaxed),
+                                  memory_order_relaxed);
+        }
+        atomic_store_explicit(&q->array, grown, memory_order_release);
+        a = grown;
+    }
+    atomic_store_explicit(&a->items[b & (a->size - 1)], item, memory_order_relaxed);
+    atomic_store_explicit(&q->bottom, b + 1, memory_order_release);
+}
+
+// Owner only, the newest item or NULL if the deque is empty
+static inline void* workDequePop(workDeque* q){
+    int64_t b = atomic_load_explicit(&q->bottom, memory_order_relaxed) - 1;
+    dequeArray* a = atomic_load_explicit(&q->array, memory_order_relaxed);
+    // seq_cst store and load: either this pop sees the thief's new top, or the thief sees this bottom
+    atomic_store_explicit(&q->bottom, b, memory_order_seq_cst);
+    int64_t t = atomic_load_explicit(&q->top, memory_order_seq_cst);
+    if(t > b){
+        atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+        return NULL;
+    }
+    void* item = atomic_load_explicit(&a->items[b & (a->size - 1)], memory_order_relaxed);
+    if(t == b){
+        // the last item: whoever moves top first gets it
+        if(!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1,
+                                                    memory_order_seq_cst, memory_order_relaxed)){
+            item = NULL;
+        }
+        atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+    }
+    return item;
+}
+
+// Any thread, the oldest item or NULL if the deque is empty or another thread took it first
+static inline void* workDequeSteal(workDeque* q){
+    int64_t t = atomic_load_explicit(&q->top, memory_order_seq_cst);
+    int64_t b = atomic_load_explicit(&q->bottom, memory_order_seq_cst);
+    if(t >= b){
+        return NULL;
+    }
+    dequeArray* a = atomic_load_explicit(&q->array, memory_order_acquire);
+    void* item = atomic_load_explicit(&a->items[t & (a->size - 1)], memory_order_relaxed);
+    if(!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1,
+                                                memory_order_seq_cst, memory_order_relaxed)){
+        return NULL;
+    }
+    return item;
+}
+
+
+// Fork-join pool
+
+typedef struct ForkJoinTask{
+    void (*run)(void* arg);
+    void* arg;
+    atomic_int done;
+} forkJoinTask;
+
+typedef struct ForkJoinWorker{
+    workDeque deque;
+    struct ForkJoinPool* pool;
+    unsigned int seed;                   // for choosing victims
+    pthread_t thread;
+} forkJoinWorker;
+
+typedef struct ForkJoinPool{
+    int threads;
+    forkJoinWorker* workers;             // workers[0] is the thread in forkJoinRun()
+    atomic_int running;                  // a forkJoinRun() is in progress
+    atomic_int stop;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+} forkJoinPool;
+
+static _Thread_local forkJoinWorker* currentWorker = NULL;
+
+static inline void forkJoinExecute(forkJoinTask* task){
+    task->run(task->arg);
+    atomic_store_explicit(&task->done, 1, memory_order_release);
+}
+
+// A task from the deque of a random other worker, NULL if none was found
+static inline forkJoinTask* forkJoinStealOne(forkJoinWorker* self){
+    forkJoinPool* pool = self->pool;
+    int first = rand_r(&self->seed) % pool->threads;
+    for(int i = 0; i < pool->threads; i++){
+        forkJoinWorker* victim = &pool->workers[(first + i) % pool->threads];
+        if(victim != self){
+            forkJoinTask* task = workDequeSteal(&victim->deque);
+            if(task != NULL){
+                return task;
+            }
+        }
+    }
+    return NULL;
+}
+
+static inline void* forkJoinWorkerLoop(void* arg){
+    forkJoinWorker* self = arg;
+    forkJoinPool* pool = self->pool;
+    currentWorker = self;
+    int spins = 0;
+    while(!atomic_load_explicit(&pool->stop, memory_order_acquire)){
+        if(!atomic_load_explicit(&pool->running, memory_order_acquire)){
+            pthread_mutex_lock(&pool->lock);
+            while(!atomic_load(&pool->running) && !atomic_load(&pool->stop)){
+                pthread_cond_wait(&pool->wake, &pool->lock);
+            }
+            pthread_mutex_unlock(&pool->lock);
+            continue;
+        }
+        forkJoinTask* task = forkJoinStealOne(self);
+        if(task != NULL){
+            forkJoinExecute(task);
+            spins = 0;
+        }
+        else if(++spins >= FORK_JOIN_SPINS){
+            sched_yield();
+            spins = 0;
+        }
+    }
+    return NULL;
+}
+
+static inline forkJoinPool* newForkJoinPool(int threads){
+    forkJoinPool* pool = malloc(sizeof(forkJoinPool));
+    pool->threads = threads < 1 ? 1 : threads;
+    pool->workers = aligned_alloc(64, (sizeof(forkJoinWorker) * pool->threads + 63) / 64 * 64);
+    atomic_init(&pool->running, 0);
+    atomic_init(&pool->stop, 0);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    for(int i = 0; i < pool->threads; i++){
+        workDequeInit(&pool->workers[i].deque);
+        pool->workers[i].pool = pool;
+        pool->workers[i].seed = 0x9e3779b9u * (i + 1);
+    }
+    for(int i = 1; i < pool->threads; i++){
+        pthread_create(&pool->workers[i].thread, NULL, forkJoinWorkerLoop, &pool->workers[i]);
+    }
+    return pool;
+}
+
+static inline void freeForkJoinPool(forkJoinPool* pool){
+    pthread_mutex_lock(&pool->lock);
+    atomic_store(&pool->stop, 1);
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    for(int i = 1; i < pool->threads; i++){
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+    for(int i = 0; i < pool->threads; i++){
+        workDequeFree(&pool->workers[i].deque);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    free(pool->workers);
+    free(pool);
+}
+
+static inline void forkJoinSpawn(forkJoinTask* task, void (*run)(void* arg), void* arg){
+    task->run = run;
+    task->arg = arg;
+    atomic_init(&task->done, 0);
+    if(currentWorker == NULL){
+        forkJoinExecute(task);
+        return;
+    }
+    workDequePush(&currentWorker->deque, task);
+}
+
+// Returns when task has finished, running other tasks meanwhile
+static inline void forkJoinSync(forkJoinTask* task){
+    forkJoinWorker* self = currentWorker;
+    int spins = 0;
+    while(!atomic_load_explicit(&task->done, memory_order_acquire)){
+        forkJoinTask* other = workDequePop(&self->deque);
+        if(other == NULL){
+            other = forkJoinStealOne(self);
+        }
+        if(other != NULL){
+            forkJoinExecute(other);
+            spins = 0;
+        }
+        else if(++spins >= FORK_JOIN_SPINS){
+            sched_yield();
+            spins = 0;
+        }
+    }
+}
+
+// Runs run(arg) on the pool; the calling thread takes part as workers[0] and returns when run() has.
+// run() must sync every task it spawns (and so must the tasks).
+static inline void forkJoinRun(forkJoinPool* pool, void (*run)(void* arg), void* arg){
+    forkJoinWorker* saved = currentWorker;
+    currentWorker = &pool->workers[0];
+    pthread_mutex_lock(&pool->lock);
+    atomic_store(&pool->running, 1);
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    run(arg);
+
+    atomic_store(&pool->running, 0);
+    currentWorker = saved;
+}
+
+#endif
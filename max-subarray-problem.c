@@ -1,5 +1,9 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <limits.h>
+#include <pthread.h>
+#include <string.h>
+#include "data-structures/work-stealing.h"
 
 #define max(a,b) \
    ({ __typeof__ (a) _a = (a); \
@@ -15,7 +19,16 @@
 // however, in this case we "remember" the sum and add the last element
 // maxSumSubArrayNLogN(A), which runs in O(nlgn), uses "divide-and-conquer" strategy, 
 // but in this version we have a helper function maxCrossingSubArray(A), which runs in linear time
+// maxSumSubArrayDC(A), which runs in O(n), is the same "divide-and-conquer", but every half
+// returns a summary of itself, so the crossing subarray is found in O(1) instead of rescanning
+// maxSumSubArrayParallel(A), which runs in O(n/p + lgp) on p threads, reduces those summaries in parallel
+// maxSumSubArrayForkJoin(A) runs the recursion of maxSumSubArrayDC() itself on a work-stealing pool
 // maxSumSubArrayN(A), which runs in O(n), also called Kadane's algorithm
+// segmentTree keeps the same summaries in a tree, so after a point update, which runs in O(lgn),
+// the maximum subarray of any range A[l..r] is found in O(lgn) instead of recomputing from scratch
+// maxSumSubMatrix(M), which runs in O(rows^2 * cols), is the 2-D version built on top of Kadane's algorithm
+// windowMax answers, for every newly appended sample, the best subarray ending at it that lies
+// within the last W samples, in amortized O(1) per sample
 
 static int arr[16] = {13, -3, -25, 20, -3, -16, -23, 18, 20, -7, 12, -5, -22, 15, -4, 7};
 
@@ -108,6 +121,222 @@ subArray maxSumSubArrayNLogN(int* a, int low, int high){
 }
 
 
+// maxCrossingSubArray() rescans the middle at every level of recursion, which gives
+// T(n) = 2T(n/2) + θ(n) = θ(nlgn). If every half returns, besides its best subarray,
+// its total sum, its best prefix and its best suffix, then the best crossing subarray
+// is simply (best suffix of the left half) + (best prefix of the right half), and the
+// recurrence becomes T(n) = 2T(n/2) + θ(1) = θ(n).
+// Combining two summaries is associative, so adjacent pieces of the array can be
+// summarized independently (e.g. by different threads) and merged afterwards in any grouping.
+typedef struct Segment{
+    int totalSum;
+    int maxPrefix, prefixEnd;      // best sum of a[low..prefixEnd]
+    int maxSuffix, suffixStart;    // best sum of a[suffixStart..high]
+    int best, bestLeft, bestRight; // best sum of a[bestLeft..bestRight]
+} segment;
+
+segment leafSegment(int* a, int i){
+    segment s = {a[i], a[i], i, a[i], i, a[i], i, i};
+    return s;
+}
+
+// Summary of the concatenation left|right, ties are broken like in maxSumSubArrayNLogN()
+segment combineSegments(segment left, segment right){
+    segment s;
+    s.totalSum = left.totalSum + right.totalSum;
+
+    s.maxPrefix = left.maxPrefix;
+    s.prefixEnd = left.prefixEnd;
+    if(left.totalSum + right.maxPrefix > s.maxPrefix){
+        s.maxPrefix = left.totalSum + right.maxPrefix;
+        s.prefixEnd = right.prefixEnd;
+    }
+
+    s.maxSuffix = right.maxSuffix;
+    s.suffixStart = right.suffixStart;
+    if(right.totalSum + left.maxSuffix > s.maxSuffix){
+        s.maxSuffix = right.totalSum + left.maxSuffix;
+        s.suffixStart = left.suffixStart;
+    }
+
+    int cross = left.maxSuffix + right.maxPrefix;
+    if(left.best >= right.best && left.best >= cross){
+        s.best = left.best;
+        s.bestLeft = left.bestLeft;
+        s.bestRight = left.bestRight;
+    }
+    else if(right.best >= left.best && right.best >= cross){
+        s.best = right.best;
+        s.bestLeft = right.bestLeft;
+        s.bestRight = right.bestRight;
+    }
+    else{
+        s.best = cross;
+        s.bestLeft = left.suffixStart;
+        s.bestRight = right.prefixEnd;
+    }
+    return s;
+}
+
+segment maxSumSubArrayDC(int* a, int low, int high){
+    if(high == low){
+        return leafSegment(a, low);
+    }
+    int mid = (low + high)/2;
+    return combineSegments(maxSumSubArrayDC(a, low, mid), maxSumSubArrayDC(a, mid + 1, high));
+}
+
+
+// Parallel version: the array is cut into p chunks of (almost) equal length, every thread
+// summarizes its own chunk with maxSumSubArrayDC(), and then the p summaries are combined
+// pairwise, level by level, like the leaves of a binary tree (lgp levels of O(1) work each).
+typedef struct SegmentTask{
+    int* a;
+    int low, high;
+    segment result;
+} segmentTask;
+
+void* segmentWorker(void* arg){
+    segmentTask* task = arg;
+    task->result = maxSumSubArrayDC(task->a, task->low, task->high);
+    return NULL;
+}
+
+segment maxSumSubArrayParallel(int* a, int length, int threads){
+    if(threads > length){
+        threads = length;
+    }
+    if(threads <= 1){
+        return maxSumSubArrayDC(a, 0, length - 1);
+    }
+
+    pthread_t* tid = malloc(sizeof(pthread_t) * threads);
+    segmentTask* tasks = malloc(sizeof(segmentTask) * threads);
+    for(int t = 0; t < threads; t++){
+        tasks[t].a = a;
+        tasks[t].low = (int)((long long)length * t / threads);
+        tasks[t].high = (int)((long long)length * (t + 1) / threads) - 1;
+        pthread_create(&tid[t], NULL, segmentWorker, &tasks[t]);
+    }
+    for(int t = 0; t < threads; t++){
+        pthread_join(tid[t], NULL);
+    }
+
+    // tree reduction: at every level neighbours at distance "step" are merged into the left one
+    for(int step = 1; step < threads; step *= 2){
+        for(int t = 0; t + step < threads; t += 2*step){
+            tasks[t].result = combineSegments(tasks[t].result, tasks[t + step].result);
+        }
+    }
+    segment res = tasks[0].result;
+
+    free(tid);
+    free(tasks);
+    return res;
+}
+
+
+// Fork-join version (data-structures/work-stealing.h): at every level of maxSumSubArrayDC() the left
+// half is spawned as a task and the right half is summarized by the current thread. Unlike the fixed
+// chunks of maxSumSubArrayParallel(), idle threads steal the halves that are still waiting, so the
+// load stays balanced even if some threads are slowed down. Below FORK_JOIN_CUTOFF elements the
+// recursion is sequential, since a spawn costs far more than combining two summaries.
+#define FORK_JOIN_CUTOFF 2048
+
+typedef struct SegmentForkTask{
+    int* a;
+    int low, high;
+    segment result;
+} segmentForkTask;
+
+void segmentForkJoin(void* arg){
+    segmentForkTask* t = arg;
+    if(t->high - t->low + 1 <= FORK_JOIN_CUTOFF){
+        t->result = maxSumSubArrayDC(t->a, t->low, t->high);
+        return;
+    }
+    int mid = (t->low + t->high)/2;
+    segmentForkTask left = {t->a, t->low, mid, {0}};
+    segmentForkTask right = {t->a, mid + 1, t->high, {0}};
+    forkJoinTask task;
+    forkJoinSpawn(&task, segmentForkJoin, &left);
+    segmentForkJoin(&right);
+    forkJoinSync(&task);
+    t->result = combineSegments(left.result, right.result);
+}
+
+segment maxSumSubArrayForkJoin(forkJoinPool* pool, int* a, int low, int high){
+    segmentForkTask root = {a, low, high, {0}};
+    forkJoinRun(pool, segmentForkJoin, &root);
+    return root.result;
+}
+
+
+// Segment tree over summaries, stored in a flat array of 2n nodes: the leaves are
+// nodes[n..2n - 1] (leaf for a[i] is nodes[n + i]) and the parent of node p is node p/2,
+// so nodes[p] = combineSegments(nodes[2p], nodes[2p + 1]). No pointers and no padding to
+// a power of two are needed. Building bottom-up runs in θ(n), since every node is combined once.
+// Query walks from both ends of the range towards the root, collecting the summaries from
+// the left side and from the right side separately, because combineSegments() is not commutative.
+typedef struct SegmentTree{
+    int n;
+    segment* nodes;
+} segmentTree;
+
+segmentTree* newSegmentTree(int* a, int n){
+    segmentTree* tree = malloc(sizeof(segmentTree));
+    tree->n = n;
+    tree->nodes = malloc(sizeof(segment) * 2 * n);
+    for(int i = 0; i < n; i++){
+        tree->nodes[n + i] = leafSegment(a, i);
+    }
+    for(int p = n - 1; p > 0; p--){
+        tree->nodes[p] = combineSegments(tree->nodes[2*p], tree->nodes[2*p + 1]);
+    }
+    return tree;
+}
+
+// a[i] = value, O(lgn)
+void segmentTreeUpdate(segmentTree* tree, int i, int value){
+    int p = tree->n + i;
+    segment leaf = {value, value, i, value, i, value, i, i};
+    tree->nodes[p] = leaf;
+    for(p /= 2; p > 0; p /= 2){
+        tree->nodes[p] = combineSegments(tree->nodes[2*p], tree->nodes[2*p + 1]);
+    }
+}
+
+// Maximum subarray of a[low..high] (inclusive), O(lgn)
+segment segmentTreeQuery(segmentTree* tree, int low, int high){
+    segment left, right;
+    int hasLeft = 0, hasRight = 0;
+    for(int l = low + tree->n, r = high + tree->n + 1; l < r; l /= 2, r /= 2){
+        if(l & 1){
+            left = hasLeft ? combineSegments(left, tree->nodes[l]) : tree->nodes[l];
+            hasLeft = 1;
+            ++l;
+        }
+        if(r & 1){
+            --r;
+            right = hasRight ? combineSegments(tree->nodes[r], right) : tree->nodes[r];
+            hasRight = 1;
+        }
+    }
+    if(!hasLeft){
+        return right;
+    }
+    if(!hasRight){
+        return left;
+    }
+    return combineSegments(left, right);
+}
+
+void freeSegmentTree(segmentTree* tree){
+    free(tree->nodes);
+    free(tree);
+}
+
+
 int maxSumSubArrayN(int* arr, int n){
 	int ans = arr[0], sum = 0;
 	for(int i = 1; i < n; ++i){
@@ -130,6 +359,164 @@ int maxSumSubArrayN(int* arr, int n){
 }
 
 
+// Kadane's algorithm again, but it also returns the bounds a[*left..*right] of the best subarray
+// and works for all-negative arrays without a separate pass
+long long kadane(const long long* a, int n, int* left, int* right){
+    long long best = a[0], sum = a[0];
+    int start = 0;
+    *left = *right = 0;
+    for(int i = 1; i < n; ++i){
+        if(sum < 0){
+            sum = a[i];
+            start = i;
+        }
+        else{
+            sum += a[i];
+        }
+        if(sum > best){
+            best = sum;
+            *left = start;
+            *right = i;
+        }
+    }
+    return best;
+}
+
+
+// Maximum-sum submatrix of a rows x cols matrix stored row by row in m[].
+// Every pair of rows (top, bottom) squashes the rows between them into one array of
+// column sums, and the best submatrix with exactly these rows is the maximum subarray
+// of the column sums. Moving bottom one row down only adds one row to the column sums,
+// so every pair costs O(cols): O(rows^2 * cols) in total.
+// The pairs with different top rows are independent, so the top rows are dealt to the threads
+// round-robin (the first top rows have the most pairs, dealing them out keeps the work balanced).
+typedef struct SubMatrix{
+    int top, left, bottom, right;
+    long long sum;
+} subMatrix;
+
+typedef struct SubMatrixTask{
+    const int* m;
+    int rows, cols;
+    int first, step;   // top rows first, first + step, first + 2*step, ...
+    subMatrix result;
+} subMatrixTask;
+
+void* subMatrixWorker(void* arg){
+    subMatrixTask* task = arg;
+    long long* colSums = malloc(sizeof(long long) * task->cols);
+    int found = 0;
+    for(int top = task->first; top < task->rows; top += task->step){
+        memset(colSums, 0, sizeof(long long) * task->cols);
+        for(int bottom = top; bottom < task->rows; ++bottom){
+            for(int c = 0; c < task->cols; ++c){
+                colSums[c] += task->m[bottom * task->cols + c];
+            }
+            int left, right;
+            long long sum = kadane(colSums, task->cols, &left, &right);
+            if(!found || sum > task->result.sum){
+                subMatrix best = {top, left, bottom, right, sum};
+                task->result = best;
+                found = 1;
+            }
+        }
+    }
+    free(colSums);
+    return NULL;
+}
+
+subMatrix maxSumSubMatrix(const int* m, int rows, int cols, int threads){
+    if(threads > rows){
+        threads = rows;
+    }
+    if(threads < 1){
+        threads = 1;
+    }
+    pthread_t* tid = malloc(sizeof(pthread_t) * threads);
+    subMatrixTask* tasks = malloc(sizeof(subMatrixTask) * threads);
+    for(int t = 0; t < threads; t++){
+        subMatrixTask task = {m, rows, cols, t, threads, {0, 0, 0, 0, LLONG_MIN}};
+        tasks[t] = task;
+        pthread_create(&tid[t], NULL, subMatrixWorker, &tasks[t]);
+    }
+    subMatrix res = {0, 0, 0, 0, LLONG_MIN};
+    for(int t = 0; t < threads; t++){
+        pthread_join(tid[t], NULL);
+        if(tasks[t].result.sum > res.sum){
+            res = tasks[t].result;
+        }
+    }
+    free(tid);
+    free(tasks);
+    return res;
+}
+
+
+// Streaming version over the last W samples.
+// Let P[k] be the sum of the first k samples (P[0] = 0). The best subarray that ends at
+// sample k and lies within the window is P[k + 1] - min(P[i]) over i in [k + 1 - W, k].
+// The candidates for the minimum are kept in a deque of increasing prefix sums:
+// a new prefix sum removes all larger ones from the back (they can never be the minimum again),
+// and indices that fell out of the window are expired from the front.
+// Every prefix sum enters and leaves the deque once, so a sample costs amortized O(1),
+// and only O(W) memory is used no matter how long the stream is.
+typedef struct WindowMax{
+    int window;
+    long long count;       // number of samples seen so far
+    long long prefix;      // P[count]
+    long long* dqIndex;    // ring buffer of size window, holding the deque
+    long long* dqPrefix;
+    int head, size;
+} windowMax;
+
+typedef struct WindowSubArray{
+    long long first, last;   // sample numbers, counting from 0 since the start of the stream
+    long long sum;
+} windowSubArray;
+
+windowMax* newWindowMax(int window){
+    windowMax* w = malloc(sizeof(windowMax));
+    w->window = window;
+    w->count = 0;
+    w->prefix = 0;
+    w->dqIndex = malloc(sizeof(long long) * window);
+    w->dqPrefix = malloc(sizeof(long long) * window);
+    w->head = w->size = 0;
+    return w;
+}
+
+windowSubArray windowMaxPush(windowMax* w, int value){
+    long long k = w->count;
+
+    // start k - W + 1 is the oldest sample still in the window
+    while(w->size > 0 && w->dqIndex[w->head] < k + 1 - w->window){
+        w->head = (w->head + 1) % w->window;
+        --(w->size);
+    }
+
+    // P[k] becomes a candidate start
+    while(w->size > 0 && w->dqPrefix[(w->head + w->size - 1) % w->window] >= w->prefix){
+        --(w->size);
+    }
+    int back = (w->head + w->size) % w->window;
+    w->dqIndex[back] = k;
+    w->dqPrefix[back] = w->prefix;
+    ++(w->size);
+
+    w->prefix += value;
+    ++(w->count);
+
+    windowSubArray res = {w->dqIndex[w->head], k, w->prefix - w->dqPrefix[w->head]};
+    return res;
+}
+
+void freeWindowMax(windowMax* w){
+    free(w->dqIndex);
+    free(w->dqPrefix);
+    free(w);
+}
+
+
 int main(int argc, char* argv[]){
   int length = sizeof(arr)/sizeof(int);
   
@@ -139,9 +526,42 @@ int main(int argc, char* argv[]){
   
   printf("%d\n", maxSumSubArrayN2(arr, length));
   
-  subArray res = maxSumSubArrayNLogN(arr, 0, length);
+  subArray res = maxSumSubArrayNLogN(arr, 0, length - 1);
   printf("%d %d %d\n", res.maxLeft, res.maxRight, res.totalSum);
+
+  segment seg = maxSumSubArrayDC(arr, 0, length - 1);
+  printf("%d %d %d\n", seg.bestLeft, seg.bestRight, seg.best);
+
+  seg = maxSumSubArrayParallel(arr, length, 4);
+  printf("%d %d %d\n", seg.bestLeft, seg.bestRight, seg.best);
+
+  forkJoinPool* pool = newForkJoinPool(4);
+  seg = maxSumSubArrayForkJoin(pool, arr, 0, length - 1);
+  printf("%d %d %d\n", seg.bestLeft, seg.bestRight, seg.best);
+  freeForkJoinPool(pool);
+
+  segmentTree* tree = newSegmentTree(arr, length);
+  seg = segmentTreeQuery(tree, 0, 6);
+  printf("%d %d %d\n", seg.bestLeft, seg.bestRight, seg.best);
+  segmentTreeUpdate(tree, 9, 7);
+  seg = segmentTreeQuery(tree, 0, length - 1);
+  printf("%d %d %d\n", seg.bestLeft, seg.bestRight, seg.best);
+  freeSegmentTree(tree);
   
   printf("%d\n", maxSumSubArrayN(arr, length));
 
+  int matrix[4*5] = { 1,  2, -1, -4, -20,
+                     -8, -3,  4,  2,   1,
+                      3,  8, 10,  1,   3,
+                     -4, -1,  1,  7,  -6};
+  subMatrix sm = maxSumSubMatrix(matrix, 4, 5, 2);
+  printf("(%d, %d) - (%d, %d): %lld\n", sm.top, sm.left, sm.bottom, sm.right, sm.sum);
+
+  windowMax* w = newWindowMax(4);
+  for(int i = 0; i < length; i++){
+      windowSubArray ws = windowMaxPush(w, arr[i]);
+      printf("[%lld..%lld] %lld\n", ws.first, ws.last, ws.sum);
+  }
+  freeWindowMax(w);
+
 }
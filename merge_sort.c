@@ -1,4 +1,7 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "data-structures/work-stealing.h"
 
 
 // Merge Sort closely follows divide-and-conquer paradigm.
@@ -58,16 +61,152 @@ void mergeSort(int* arr, int low, int high)
 }
 
 
+// Multithreaded merge sort (CLRS, chapter 27), run on a fork-join pool (data-structures/work-stealing.h).
+// Sorting the two halves in parallel alone is not enough: the final merge() still takes θ(n),
+// so the span would be θ(n) and the parallelism only θ(lgn). parallelMerge() therefore also splits:
+// it takes the middle element x of the longer input, finds by binary search where x goes in the
+// shorter one, puts x at its final place and merges the two pairs of smaller pieces in parallel.
+// That gives span θ(lg^2 n) for the merge and θ(lg^3 n) for the sort, with work θ(nlgn).
+// Instead of copying to L and R at every level, the levels alternate between arr and a scratch
+// array of the same length: the halves are sorted into one of them and merged into the other.
+// Below PARALLEL_CUTOFF elements the spawns cost more than they save, so the sequential code runs.
+
+#define PARALLEL_CUTOFF 4096
+
+typedef struct MergeTask{
+    const int* src;
+    int low1, high1, low2, high2;    // the sorted src[low1..high1] and src[low2..high2]
+    int* dst;
+    int start;                       // are merged into dst[start..]
+} mergeTask;
+
+typedef struct SortTask{
+    int* arr;
+    int* scratch;
+    int low, high;
+    int toScratch;                   // the sorted arr[low..high] ends up in scratch[low..high]
+} sortTask;
+
+// The first index in src[low..high] with src[index] >= x (high + 1 if none)
+int lowerBound(const int* src, int low, int high, int x){
+    int hi = high + 1;
+    while(low < hi){
+        int mid = low + (hi - low)/2;
+        if(src[mid] < x){
+            low = mid + 1;
+        }
+        else{
+            hi = mid;
+        }
+    }
+    return low;
+}
+
+void parallelMerge(void* arg){
+    mergeTask* t = arg;
+    int n1 = t->high1 - t->low1 + 1;
+    int n2 = t->high2 - t->low2 + 1;
+    if(n1 < n2){
+        int tmp = t->low1; t->low1 = t->low2; t->low2 = tmp;
+        tmp = t->high1; t->high1 = t->high2; t->high2 = tmp;
+        tmp = n1; n1 = n2; n2 = tmp;
+    }
+    if(n1 == 0){
+        return;
+    }
+    if(n1 + n2 <= PARALLEL_CUTOFF){
+        int i = t->low1, j = t->low2, k = t->start;
+        while(i <= t->high1 && j <= t->high2){
+            t->dst[k++] = t->src[i] <= t->src[j] ? t->src[i++] : t->src[j++];
+        }
+        while(i <= t->high1){
+            t->dst[k++] = t->src[i++];
+        }
+        while(j <= t->high2){
+            t->dst[k++] = t->src[j++];
+        }
+        return;
+    }
+    int mid1 = (t->low1 + t->high1)/2;
+    int mid2 = lowerBound(t->src, t->low2, t->high2, t->src[mid1]);
+    int place = t->start + (mid1 - t->low1) + (mid2 - t->low2);
+    t->dst[place] = t->src[mid1];
+
+    mergeTask left = {t->src, t->low1, mid1 - 1, t->low2, mid2 - 1, t->dst, t->start};
+    mergeTask right = {t->src, mid1 + 1, t->high1, mid2, t->high2, t->dst, place + 1};
+    forkJoinTask task;
+    forkJoinSpawn(&task, parallelMerge, &left);
+    parallelMerge(&right);
+    forkJoinSync(&task);
+}
+
+void parallelSortTask(void* arg){
+    sortTask* t = arg;
+    if(t->high - t->low + 1 <= PARALLEL_CUTOFF){
+        mergeSort(t->arr, t->low, t->high);
+        if(t->toScratch){
+            memcpy(t->scratch + t->low, t->arr + t->low, sizeof(int) * (t->high - t->low + 1));
+        }
+        return;
+    }
+    int mid = t->low + (t->high - t->low)/2;
+    // the halves go to the other array, so that merging them brings the result where it belongs
+    sortTask left = {t->arr, t->scratch, t->low, mid, !t->toScratch};
+    sortTask right = {t->arr, t->scratch, mid + 1, t->high, !t->toScratch};
+    forkJoinTask task;
+    forkJoinSpawn(&task, parallelSortTask, &left);
+    parallelSortTask(&right);
+    forkJoinSync(&task);
+
+    const int* src = t->toScratch ? t->arr : t->scratch;
+    int* dst = t->toScratch ? t->scratch : t->arr;
+    mergeTask merge = {src, t->low, mid, mid + 1, t->high, dst, t->low};
+    parallelMerge(&merge);
+}
+
+// Sorts arr[low..high] on the pool (or sequentially if pool is NULL)
+void parallelMergeSort(forkJoinPool* pool, int* arr, int low, int high){
+    if(low >= high){
+        return;
+    }
+    int* scratch = malloc(sizeof(int) * (high + 1));
+    sortTask root = {arr, scratch, low, high, 0};
+    if(pool != NULL){
+        forkJoinRun(pool, parallelSortTask, &root);
+    }
+    else{
+        parallelSortTask(&root);
+    }
+    free(scratch);
+}
+
+
 int main(int argc, char* argv[]){
 
     int arr[10] = {6, 2, 8, 5, 4, 9, 3, 10, 1, 7};
 
     int length = sizeof(arr)/sizeof(int);
 
-    mergeSort(arr, 0, length);
+    mergeSort(arr, 0, length - 1);
 
     for (int i = 0; i < length; i++){
         printf("%d ", arr[i]);
     }
+    printf("\n");
+
+    int n = 1000000;
+    int* big = malloc(sizeof(int) * n);
+    for (int i = 0; i < n; i++){
+        big[i] = rand();
+    }
+    forkJoinPool* pool = newForkJoinPool(4);
+    parallelMergeSort(pool, big, 0, n - 1);
+    freeForkJoinPool(pool);
+    int sorted = 1;
+    for (int i = 1; i < n; i++){
+        sorted = sorted && big[i - 1] <= big[i];
+    }
+    printf("%d elements sorted: %d\n", n, sorted);
+    free(big);
 
 }
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include "data-structures/work-stealing.h"
 
 // Quicksort algorithm applies the divide-and-conquer paradigm in-place
 // Steps:
@@ -112,6 +113,103 @@ void hoareQuickSort(int* a, int low, int high){
 }
 
 
+// Parallel quicksort on a fork-join pool (data-structures/work-stealing.h): after partitioning,
+// the two sides are independent, so one of them is spawned as a task, that an idle thread may steal,
+// while the current thread sorts the other one. The partition itself stays sequential, so the
+// span is θ(n) (n + n/2 + n/4 + ...) and the parallelism is only θ(lgn), but every level of
+// recursion roughly doubles the number of busy threads.
+// The pivot is the median of a[low], a[mid] and a[high], so sorted input does not produce one
+// subproblem of n - 1 elements at every level, which would leave nothing to run in parallel.
+// partition() above sends every key equal to the pivot to the left side, so an array with few distinct
+// keys (all equal, at worst) is split into n - 1 and 0 elements at every level: θ(n^2). Here the array
+// is split in three instead (Dijkstra's "Dutch national flag"): keys less than, equal to and greater
+// than the pivot. The equal keys are in their final place and take part in no recursive call, so the
+// more duplicates there are, the less work is left, and all equal keys take θ(n).
+// Below PARALLEL_CUTOFF elements a spawn costs more than it saves, and threeWayQuickSort(), the same
+// partitioning without tasks, is called instead. It recurses into the smaller side and loops on the
+// larger one, so its stack stays O(lgn) deep.
+
+#define PARALLEL_CUTOFF 4096
+
+typedef struct QuickSortTask{
+    int* a;
+    int low, high;
+} quickSortTask;
+
+// The median of a[low], a[mid] and a[high]
+int medianOfThree(int* a, int low, int high){
+    int x = a[low], y = a[low + (high - low)/2], z = a[high];
+    if(x < y){
+        return y < z ? y : (x < z ? z : x);
+    }
+    return x < z ? x : (y < z ? z : y);
+}
+
+// Rearranges a[low..high] around the value x into a[low..*lt-1] < x, a[*lt..*gt] == x, a[*gt+1..high] > x
+void threeWayPartition(int* a, int low, int high, int x, int* lt, int* gt){
+    int l = low, i = low, g = high;
+    while(i <= g){
+        if(a[i] < x){
+            int tmp = a[l];
+            a[l++] = a[i];
+            a[i++] = tmp;
+        }
+        else if(a[i] > x){
+            int tmp = a[g];
+            a[g--] = a[i];
+            a[i] = tmp;
+        }
+        else{
+            ++i;
+        }
+    }
+    *lt = l;
+    *gt = g;
+}
+
+void threeWayQuickSort(int* a, int low, int high){
+    while(low < high){
+        int lt, gt;
+        threeWayPartition(a, low, high, medianOfThree(a, low, high), &lt, &gt);
+        if(lt - low < high - gt){
+            threeWayQuickSort(a, low, lt - 1);
+            low = gt + 1;
+        }
+        else{
+            threeWayQuickSort(a, gt + 1, high);
+            high = lt - 1;
+        }
+    }
+}
+
+void parallelQuickSortTask(void* arg){
+    quickSortTask* t = arg;
+    if(t->high - t->low + 1 <= PARALLEL_CUTOFF){
+        threeWayQuickSort(t->a, t->low, t->high);
+        return;
+    }
+    int lt, gt;
+    threeWayPartition(t->a, t->low, t->high, medianOfThree(t->a, t->low, t->high), &lt, &gt);
+    quickSortTask left = {t->a, t->low, lt - 1};
+    quickSortTask right = {t->a, gt + 1, t->high};
+    forkJoinTask task;
+    forkJoinSpawn(&task, parallelQuickSortTask, &left);
+    parallelQuickSortTask(&right);
+    forkJoinSync(&task);
+}
+
+// Sorts a[low..high] on the pool (or sequentially if pool is NULL)
+void parallelQuickSort(forkJoinPool* pool, int* a, int low, int high){
+    quickSortTask root = {a, low, high};
+    if(pool != NULL){
+        forkJoinRun(pool, parallelQuickSortTask, &root);
+    }
+    else{
+        parallelQuickSortTask(&root);
+    }
+}
+
+
 int main(int argc, char* argv[]){
   
     int arr[10] = {6, 2, 8, 5, 4, 9, 3, 10, 1, 7};
@@ -125,5 +223,33 @@ int main(int argc, char* argv[]){
     for (int i = 0; i < length; i++){
         printf("%d ", arr[i]);
     }
+    printf("\n");
+
+    int n = 1000000;
+    int* big = malloc(sizeof(int) * n);
+    for (int i = 0; i < n; i++){
+        big[i] = rand();
+    }
+    forkJoinPool* pool = newForkJoinPool(4);
+    parallelQuickSort(pool, big, 0, n - 1);
+    freeForkJoinPool(pool);
+    int sorted = 1;
+    for (int i = 1; i < n; i++){
+        sorted = sorted && big[i - 1] <= big[i];
+    }
+    printf("%d elements sorted: %d\n", n, sorted);
+
+    // only 16 distinct keys: partition() would be quadratic here
+    for (int i = 0; i < n; i++){
+        big[i] = rand() % 16;
+    }
+    pool = newForkJoinPool(4);
+    parallelQuickSort(pool, big, 0, n - 1);
+    freeForkJoinPool(pool);
+    for (int i = 1; i < n; i++){
+        sorted = sorted && big[i - 1] <= big[i];
+    }
+    printf("%d elements with 16 distinct keys sorted: %d\n", n, sorted);
+    free(big);
 
 }